@@ -7,6 +7,7 @@
 /* storage control modules to the FatFs module with a defined API.       */
 /*-----------------------------------------------------------------------*/
 
+#include <string.h>
 #include "ff.h"			/* Obtains integer types */
 #include "diskio.h"		/* Declarations of disk functions */
 
@@ -17,6 +18,263 @@
 
 int sd_initialized = 0;
 
+#ifdef SD_NATIVE
+static int sd_native = -1;	/* -1: not tried yet, 0: SPI mode, 1: native 4-bit mode */
+#endif
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Card session                                                          */
+/*-----------------------------------------------------------------------*/
+/* The card is initialized once, then disk_initialize() and disk_status()
+/  only check that the session is still alive: not at all within
+/  SESSION_IDLE_MS of a successful transfer, otherwise with a status command
+/  (CMD13). A failed transfer checks the status too, and the session ends
+/  when that fails or after SESSION_MAX_ERRORS failures in a row. Dirty cache
+/  lines are written back first, in case the card still answers. The next
+/  disk_initialize() then starts a new session, which drops the sector cache
+/  as the card may have been changed. Dirty lines dropped there are logged,
+/  and the next CTRL_SYNC fails. */
+
+#define SESSION_IDLE_MS		1000
+#define SESSION_MAX_ERRORS	3
+#define SESSION_INIT_TRIES	3
+
+static DWORD session_time;			/* last time the card answered */
+static int session_errors;			/* failed transfers in a row */
+static int cache_syncing;			/* in cache_sync() */
+static int cache_lost;				/* dirty lines were dropped, fail CTRL_SYNC */
+
+static int cache_sync (void);
+
+/* 1: the card answers a status command */
+static int card_status (void)
+{
+#ifdef SD_NATIVE
+	if (sd_native == 1)
+		return sdn_status() == 0;
+#endif
+	return sd_status() == 0;
+}
+
+static void session_end (void)
+{
+	if (!cache_syncing)
+		cache_sync();			/* the card may still take the writes */
+	if (sd_initialized) {
+		LOG_WARN("SD card session ended\n");
+		sd_initialized = 0;
+	}
+}
+
+/* account for a card transfer, returns ok */
+static int session_transfer (int ok)
+{
+	if (ok) {
+		session_time = time_millis();
+		session_errors = 0;
+	} else if (++session_errors >= SESSION_MAX_ERRORS || !card_status())
+		session_end();
+	return ok;
+}
+
+static int session_alive (void)
+{
+	if (!sd_initialized)
+		return 0;
+	if (time_millis() - session_time < SESSION_IDLE_MS)
+		return 1;
+	if (!card_status()) {
+		session_end();
+		return 0;
+	}
+	session_time = time_millis();
+	return 1;
+}
+
+/* Card access, 1: success, 0: failure */
+static int card_read (BYTE *buff, LBA_t sector, UINT count)
+{
+	PROF_BEGIN("sd_read");
+#ifdef SD_NATIVE
+	int ok = sd_native == 1 ? sdn_readsector(sector, buff, count) : sd_readsector(sector, buff, count);
+#else
+	int ok = sd_readsector(sector, buff, count);
+#endif
+	PROF_END("sd_read");
+	return session_transfer(ok);
+}
+
+static int card_write (const BYTE *buff, LBA_t sector, UINT count)
+{
+	PROF_BEGIN("sd_write");
+#ifdef SD_NATIVE
+	int ok = sd_native == 1 ? sdn_writesector(sector, buff, count) : sd_writesector(sector, buff, count);
+#else
+	int ok = sd_writesector(sector, buff, count);
+#endif
+	PROF_END("sd_write");
+	return session_transfer(ok);
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Sector cache                                                          */
+/*-----------------------------------------------------------------------*/
+/* LRU cache of sectors in RV RAM above the firmware (2MB-4MB, see
+/  baremetal.ld), so FAT chain walks, directory scans and repeated opens do
+/  not go to the card. Sequential misses also read ahead. Writes stay in the
+/  cache until CTRL_SYNC (f_sync, f_close) or eviction. Requests of
+/  CACHE_BYPASS sectors or more, like large file reads, go to the card
+/  directly. */
+
+#define CACHE_DATA		((BYTE *)0x200000)
+#define CACHE_LINES		4096		/* 2MB */
+#define CACHE_HASH		1024
+#define CACHE_NONE		0xFFFF
+#define CACHE_BYPASS	8			/* sectors */
+#define CACHE_RUN		16			/* max sectors per card access from the cache */
+#define READ_AHEAD		8			/* sectors */
+
+#define LINE_DATA(i)	(CACHE_DATA + (DWORD)(i) * 512)
+#define HASH(s)			((DWORD)(s) & (CACHE_HASH - 1))
+
+typedef struct {
+	LBA_t	sector;
+	WORD	prev, next;		/* LRU list, prev is more recently used */
+	WORD	hnext;			/* hash chain */
+	BYTE	valid, dirty;
+} CLINE;
+
+static CLINE cline[CACHE_LINES];
+static WORD chash[CACHE_HASH];
+static WORD lru_head, lru_tail;		/* most and least recently used */
+static LBA_t next_seq;				/* sector after the last read, for read-ahead */
+static BYTE stage[CACHE_RUN * 512] __attribute__((aligned(4)));
+DWORD disk_generation;				/* changes whenever the cache is dropped */
+
+static void lru_unlink (WORD i)
+{
+	CLINE *l = &cline[i];
+	if (l->prev != CACHE_NONE) cline[l->prev].next = l->next; else lru_head = l->next;
+	if (l->next != CACHE_NONE) cline[l->next].prev = l->prev; else lru_tail = l->prev;
+}
+
+static void lru_push (WORD i)		/* make i the most recently used */
+{
+	cline[i].prev = CACHE_NONE;
+	cline[i].next = lru_head;
+	if (lru_head != CACHE_NONE) cline[lru_head].prev = i; else lru_tail = i;
+	lru_head = i;
+}
+
+static void lru_touch (WORD i)
+{
+	if (i != lru_head) {
+		lru_unlink(i);
+		lru_push(i);
+	}
+}
+
+void disk_cache_invalidate (void)
+{
+	lru_head = lru_tail = CACHE_NONE;
+	for (WORD i = 0; i < CACHE_LINES; i++) {
+		cline[i].valid = cline[i].dirty = 0;
+		lru_push(i);
+	}
+	for (WORD h = 0; h < CACHE_HASH; h++)
+		chash[h] = CACHE_NONE;
+	next_seq = 0;
+	disk_generation++;
+}
+
+static WORD cache_find (LBA_t sector)
+{
+	WORD i = chash[HASH(sector)];
+	while (i != CACHE_NONE && cline[i].sector != sector)
+		i = cline[i].hnext;
+	return i;
+}
+
+/* Write a dirty line together with the dirty lines of the following sectors,
+/  CACHE_RUN sectors per card access, up to the end of the run */
+static int cache_writeback (WORD i)
+{
+	while (i != CACHE_NONE && cline[i].dirty) {
+		LBA_t sector = cline[i].sector;
+		UINT n = 0;
+		while (n < CACHE_RUN && i != CACHE_NONE && cline[i].dirty) {
+			memcpy(stage + n * 512, LINE_DATA(i), 512);
+			i = cache_find(sector + ++n);
+		}
+		if (!card_write(stage, sector, n))
+			return 0;		/* lines stay dirty, to be retried */
+		for (UINT k = 0; k < n; k++)
+			cline[cache_find(sector + k)].dirty = 0;
+	}
+	return 1;
+}
+
+/* Take the least recently used line for sector, which must not be cached.
+/  Returns 0 if writing back the evicted dirty line failed, the line then
+/  stays dirty and cached and no line is allocated. */
+static int cache_alloc (LBA_t sector, WORD *line)
+{
+	WORD i = lru_tail;
+	CLINE *l = &cline[i];
+	if (l->dirty) {
+		if (!card_write(LINE_DATA(i), l->sector, 1))	/* stage may be in use */
+			return 0;
+		l->dirty = 0;
+	}
+	if (l->valid) {
+		WORD *p = &chash[HASH(l->sector)];
+		while (*p != i) p = &cline[*p].hnext;
+		*p = l->hnext;
+	}
+	l->sector = sector;
+	l->valid = 1;
+	l->hnext = chash[HASH(sector)];
+	chash[HASH(sector)] = i;
+	lru_touch(i);
+	*line = i;
+	return 1;
+}
+
+static int cache_dirty_count (void)
+{
+	int n = 0;
+	for (WORD i = 0; i < CACHE_LINES; i++)
+		n += cline[i].dirty;
+	return n;
+}
+
+/* Write back all dirty lines, returns 0 if any is left */
+static int cache_sync (void)
+{
+	int ok = 1;
+	cache_syncing = 1;
+	for (WORD i = 0; i < CACHE_LINES; i++) {
+		if (!cline[i].dirty) continue;
+		if (!sd_initialized) {	/* the session ended */
+			ok = 0;
+			break;
+		}
+		/* go back to the start of the dirty run, to write it in one go */
+		LBA_t s = cline[i].sector;
+		WORD p;
+		while (s > 0 && (p = cache_find(s - 1)) != CACHE_NONE && cline[p].dirty)
+			s--;
+		if (!cache_writeback(cache_find(s)))
+			ok = 0;
+	}
+	cache_syncing = 0;
+	return ok;
+}
+
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
 /*-----------------------------------------------------------------------*/
@@ -27,10 +285,7 @@ DSTATUS disk_status (
 {
 	switch (pdrv) {
 	case DEV_SD :
-		if (sd_initialized)
-			return 0;		// success
-		else
-			return STA_NOINIT;
+		return session_alive() ? 0 : STA_NOINIT;
 	}
 	return STA_NOINIT;
 }
@@ -49,14 +304,34 @@ DSTATUS disk_initialize (
 
 	switch (pdrv) {
 	case DEV_SD :
-		if (sd_init() == 0) {
-			sd_initialized = 1;
+		if (session_alive())
 			return 0;
-		} else {
-			print("Cannot initialize sd\n");
-			sd_initialized = 0;
-			return STA_NOINIT;
+		/* new session, the card may have been changed */
+		if (cache_dirty_count()) {
+			LOG_ERROR("SD card: %d unwritten sectors dropped\n", cache_dirty_count());
+			cache_lost = 1;
+		}
+		disk_cache_invalidate();
+		for (int i = 0; i < SESSION_INIT_TRIES; i++) {
+#ifdef SD_NATIVE
+			// a card only leaves SPI mode by power cycling, so stay in SPI mode if
+			// the first native init fails, and stay native after it succeeds
+			if (sd_native != 0) {
+				sd_initialized = sdn_init() == 0;
+				if (sd_native == -1 && (sd_initialized || i == SESSION_INIT_TRIES - 1))
+					sd_native = sd_initialized;
+			}
+			if (sd_native == 0)
+#endif
+			sd_initialized = sd_init() == 0;
+			if (sd_initialized) {
+				session_time = time_millis();
+				session_errors = 0;
+				return 0;
+			}
 		}
+		print("Cannot initialize sd\n");
+		return STA_NOINIT;
 	}
 	return STA_NOINIT;
 }
@@ -78,10 +353,46 @@ DRESULT disk_read (
 	case DEV_SD :
 		if (!sd_initialized)
 			return RES_NOTRDY;
-		if (sd_readsector(sector, buff, count))
-			return RES_OK;		// return 1 for success
-		else
-			return RES_ERROR;
+		if (count >= CACHE_BYPASS) {
+			if (!card_read(buff, sector, count))
+				return RES_ERROR;
+			for (UINT k = 0; k < count; k++) {	/* dirty lines are newer than the card */
+				WORD i = cache_find(sector + k);
+				if (i != CACHE_NONE && cline[i].dirty)
+					memcpy(buff + k * 512, LINE_DATA(i), 512);
+			}
+			next_seq = sector + count;
+			return RES_OK;
+		}
+		int sequential = sector == next_seq;
+		next_seq = sector + count;
+		while (count) {
+			WORD i = cache_find(sector);
+			if (i != CACHE_NONE) {
+				memcpy(buff, LINE_DATA(i), 512);
+				lru_touch(i);
+				buff += 512; sector++; count--;
+				continue;
+			}
+			/* read the missing sectors, and some more if access is sequential */
+			UINT n = 1, total;
+			while (n < count && cache_find(sector + n) == CACHE_NONE)
+				n++;
+			total = n;
+			while (sequential && total < n + READ_AHEAD && total < CACHE_RUN &&
+					cache_find(sector + total) == CACHE_NONE)
+				total++;
+			if (!card_read(stage, sector, total))
+				return RES_ERROR;
+			for (UINT k = 0; k < total; k++) {
+				if (!cache_alloc(sector + k, &i))
+					return RES_ERROR;
+				memcpy(LINE_DATA(i), stage + k * 512, 512);
+			}
+			memcpy(buff, stage, n * 512);
+			buff += n * 512; sector += n; count -= n;
+		}
+		return RES_OK;
 	}
 	return RES_PARERR;
 }
@@ -105,10 +416,28 @@ DRESULT disk_write (
 	case DEV_SD :
 		if (!sd_initialized)
 			return RES_NOTRDY;
-		if (sd_writesector(sector, buff, count))
-			return RES_OK;		// return 1 for success
-		else
-			return RES_ERROR;
+		if (count >= CACHE_BYPASS) {
+			int ok = card_write(buff, sector, count);
+			for (UINT k = 0; k < count; k++) {	/* keep cached copies current */
+				WORD i = cache_find(sector + k);
+				if (i != CACHE_NONE) {
+					memcpy(LINE_DATA(i), buff + k * 512, 512);
+					cline[i].dirty = !ok;
+				}
+			}
+			return ok ? RES_OK : RES_ERROR;
+		}
+		for (; count; count--, sector++, buff += 512) {
+			WORD i = cache_find(sector);
+			if (i == CACHE_NONE) {
+				if (!cache_alloc(sector, &i))
+					return RES_ERROR;
+			} else
+				lru_touch(i);
+			memcpy(LINE_DATA(i), buff, 512);
+			cline[i].dirty = 1;
+		}
+		return RES_OK;
 	}
 
 	return RES_PARERR;
@@ -129,6 +458,13 @@ DRESULT disk_ioctl (
 {
 	switch (pdrv) {
 	case DEV_SD :
+		if (cmd == CTRL_SYNC) {
+			if (cache_lost) {
+				cache_lost = 0;
+				return RES_ERROR;
+			}
+			return cache_sync() ? RES_OK : RES_ERROR;
+		}
 		if (cmd == GET_SECTOR_SIZE)
 			return 512;
 		else if (cmd == GET_BLOCK_SIZE)
@@ -31,6 +31,8 @@ DSTATUS disk_status (BYTE pdrv);
 DRESULT disk_read (BYTE pdrv, BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
+void disk_cache_invalidate (void);	/* drop the sector cache, e.g. after a card change */
+extern DWORD disk_generation;		/* incremented by disk_cache_invalidate() */
 
 
 /* Disk Status Bits (DSTATUS) */
@@ -7,6 +7,7 @@
 #include <stdbool.h>
 #include "picorv32.h"
 #include "fatfs/ff.h"
+#include "fatfs/diskio.h"
 #include "firmware.h"
 
 uint32_t CORE_ID;
@@ -33,7 +34,6 @@ bool core_running;
 int core_backup_size;
 bool core_backup_valid;		// whether it is okay to save
 char core_backup_name[256];
-uint16_t snes_bsram_crc16;
 uint32_t core_backup_time;
 
 const int GBA_BACKUP_NONE = 0;
@@ -71,7 +71,7 @@ int load_option()  {
         key = trimwhitespace(line);
         value = trimwhitespace(s+1);
         // status("");
-        uart_printf("key=%s, value=%s\n", key, value);
+        LOG_DEBUG("key=%s, value=%s\n", key, value);
         // message("see below",1);
 
         // now handle all key-value pairs
@@ -201,6 +201,61 @@ void message(char *msg, int center) {
 
 
 FATFS fs;
+DWORD fs_generation;        // disk_generation when fs was mounted
+
+// Check the card session, which is cheap while the card is there (diskio.c).
+// If the card was initialized again, e.g. after it was swapped, mount it again.
+// Cached listings are dropped by the new disk_generation.
+// return 0 if the card is ready
+int sd_ready() {
+    if (disk_initialize(0))
+        return 99;
+    if (fs_generation != disk_generation) {
+        if (f_mount(&fs, "", 1) != FR_OK)
+            return 98;
+        fs_generation = disk_generation;
+    }
+    return 0;
+}
+
+// Cluster link maps (FatFs fast seek) for the ROM and save files being read,
+// from a small pool. With a map, f_lseek() and f_read() find clusters without
+// following the FAT chain, and stream_file() gets the contiguous runs. Files
+// with more fragments than a map holds are read the normal way.
+#define CLMT_SLOTS      2
+#define CLMT_SIZE       128             // entries, up to 63 fragments
+static DWORD clmt_pool[CLMT_SLOTS][CLMT_SIZE];
+static FIL *clmt_user[CLMT_SLOTS];
+
+// f_open() for reading, with a link map if a slot is free
+FRESULT fast_open(FIL *f, const char *path) {
+    FRESULT r = f_open(f, path, FA_READ);
+    if (r != FR_OK)
+        return r;
+    for (int i = 0; i < CLMT_SLOTS; i++) {
+        if (clmt_user[i])
+            continue;
+        clmt_pool[i][0] = CLMT_SIZE;
+        f->cltbl = clmt_pool[i];
+        if (f_lseek(f, CREATE_LINKMAP) == FR_OK)
+            clmt_user[i] = f;
+        else {
+            DEBUG("fast_open: %s needs %d map entries\n", path, clmt_pool[i][0]);
+            f->cltbl = NULL;
+        }
+        break;
+    }
+    return FR_OK;
+}
+
+// f_close() for files from fast_open(), frees the link map
+FRESULT fast_close(FIL *f) {
+    for (int i = 0; i < CLMT_SLOTS; i++)
+        if (clmt_user[i] == f)
+            clmt_user[i] = NULL;
+    f->cltbl = NULL;
+    return f_close(f);
+}
 
 #define PAGESIZE 22
 #define TOPLINE 2
@@ -213,43 +268,323 @@ int file_dir[PAGESIZE];
 int file_sizes[PAGESIZE];
 int file_len;		// number of files on this page
 
-// starting from `start`, load `len` file names into file_names, 
-// file_dir. 
-// *count is set to number of all valid entries and `file_len` is
-// set to valid entries on this page.
-// return: 0 if successful
-int load_dir(char *dir, int start, int len, int *count) {
-    DEBUG("load_dir: %s, start=%d, len=%d\n", dir, start, len);
-    int cnt = 0;
-    DIR d;
-    file_len = 0;
-    // initiaze sd again to be sure
-    int init_ok = 0;
-    for (int i = 0; i <= 10; i++)
-        if (sd_init() == 0) {
-            init_ok = 1;
-            break;
+// Directory listings, cached in RAM so paging and going back to a directory do
+// not read the card again. Each of the DIR_SLOTS listings has its entries and a
+// string arena with the names. Entry 0 is ".." or "<< Return to main menu".
+// Listings are dropped when the card changes. Entries after 0 are sorted:
+// directories first, then by name ignoring case.
+#define DIR_CACHE       0x400000        // 3MB at 4MB, see baremetal.ld
+#define DIR_SLOTS       3
+#define DIR_SLOT_SIZE   (1024*1024)
+#define DIR_MAX         8192            // entries per directory
+#define DIR_IS_DIR      0x80000000
+struct dir_entry {
+    uint32_t name;      // offset in the names, DIR_IS_DIR for directories
+    uint32_t size;
+    uint32_t stamp;     // fdate << 16 | ftime
+    uint32_t info;      // ROM header info from the index, see rom_info()
+};
+#define DIR_NAMES_SIZE  (DIR_SLOT_SIZE - DIR_MAX * sizeof(struct dir_entry))
+struct dir_slot {
+    char path[PWD_SIZE];
+    int count;          // -1: dropped
+    uint32_t generation;
+    uint32_t used;      // last use, for replacement
+} dir_slots[DIR_SLOTS];
+struct dir_slot *dir_cur;               // listing of the last load_dir()
+struct dir_entry *dir_entries;          // of dir_cur
+char *dir_names;
+uint32_t dir_clock;
+
+static void dir_select(int i) {
+    dir_cur = &dir_slots[i];
+    dir_cur->used = ++dir_clock;
+    dir_entries = (struct dir_entry *)(DIR_CACHE + i * DIR_SLOT_SIZE);
+    dir_names = (char *)dir_entries + DIR_MAX * sizeof(struct dir_entry);
+}
+
+// forget the cached listing of dir, after files are created there
+void dir_cache_drop(char *dir) {
+    for (int i = 0; i < DIR_SLOTS; i++)
+        if (dir_slots[i].count >= 0 && strcmp(dir, dir_slots[i].path) == 0)
+            dir_slots[i].count = -1;
+}
+
+static void dir_add(uint32_t *bytes, const char *name, uint32_t flags, uint32_t size, uint32_t stamp) {
+    struct dir_entry *e = &dir_entries[dir_cur->count++];
+    strcpy(dir_names + *bytes, name);
+    e->name = *bytes | flags;
+    e->size = size;
+    e->stamp = stamp;
+    e->info = 0;
+    *bytes += strlen(name) + 1;
+}
+
+static inline char *dir_name(int i) {
+    return dir_names + (dir_entries[i].name & ~DIR_IS_DIR);
+}
+
+// listing order: directories first, then names ignoring case
+static int dir_order(uint32_t dir_a, const char *a, uint32_t dir_b, const char *b) {
+    if (dir_a != dir_b)
+        return dir_a ? -1 : 1;
+    int r = strcasecmp(a, b);
+    return r ? r : strcmp(a, b);
+}
+
+static int dir_cmp(struct dir_entry *a, struct dir_entry *b) {
+    return dir_order(a->name & DIR_IS_DIR, dir_names + (a->name & ~DIR_IS_DIR),
+                     b->name & DIR_IS_DIR, dir_names + (b->name & ~DIR_IS_DIR));
+}
+
+// shell sort of entries 1..count-1
+static void dir_sort() {
+    static const int gaps[] = {701, 301, 132, 57, 23, 10, 4, 1};
+    struct dir_entry *e = dir_entries + 1;
+    int n = dir_cur->count - 1;
+    for (int g = 0; g < sizeof(gaps)/sizeof(gaps[0]); g++) {
+        int gap = gaps[g];
+        for (int i = gap; i < n; i++) {
+            struct dir_entry t = e[i];
+            int j;
+            for (j = i; j >= gap && dir_cmp(&e[j-gap], &t) > 0; j -= gap)
+                e[j] = e[j-gap];
+            e[j] = t;
         }
-    if (!init_ok) return 99;
+    }
+}
 
-    if (f_opendir(&d, dir) != 0) {
-        return -1;
+// ROM index: for each directory, /.tangcore/<hash of path>.idx keeps the sorted
+// entries with header info parsed from the ROMs. When the directory is read
+// again, it is merged with the listing and only new or changed files (name,
+// size or time stamp differ) are opened. The stamp is per file, as FAT does not
+// update the time of a directory when files in it change.
+#define INDEX_DIR       "/.tangcore"
+#define INDEX_MAGIC     0x58444954      // "TIDX"
+#define INDEX_VERSION   1
+#define INFO_VALID      0x80000000      // header info is parsed, rest is 0 if not a ROM
+struct index_header {
+    uint32_t magic, version, core_id, count;
+    char path[256];                     // of the directory, in case hashes collide
+};
+struct index_rec {                      // followed by name_len bytes of name
+    uint32_t size, stamp, info;
+    uint8_t dir, name_len;
+};
+#define INDEX_REC_SIZE  14
+
+static void index_path(char *dir, char *path) {
+    uint32_t h = 2166136261u;           // FNV-1a
+    for (char *p = dir; *p; p++)
+        h = (h ^ (uint8_t)*p) * 16777619u;
+    strcpy(path, INDEX_DIR "/");
+    char *p = path + strlen(path);
+    for (int i = 28; i >= 0; i -= 4)
+        *p++ = "0123456789abcdef"[h >> i & 0xf];
+    strcpy(p, ".idx");
+}
+
+// parse the header of a ROM for the index
+// MD: [23:0] region characters from 0x1F0
+// SNES: [7:0] map_ctrl, [15:8] rom_size, [23:16] ram_size
+static uint32_t rom_info(char *dir, char *name, uint32_t size) {
+    uint32_t info = INFO_VALID;
+    FIL f;
+    unsigned int br;
+    char path[PWD_SIZE+256];
+    strncpy(path, dir, PWD_SIZE);
+    strncat(path, "/", PWD_SIZE+256);
+    strncat(path, name, PWD_SIZE+256);
+
+    if (CORE_ID == CORE_MD && strcasestr(name, ".bin")) {
+        // a single seek, the link map would not pay off
+        if (f_open(&f, path, FA_READ))
+            return info;
+        char region[3];
+        if (f_lseek(&f, 0x1f0) == FR_OK && f_read(&f, region, 3, &br) == FR_OK && br == 3)
+            for (int i = 0; i < 3; i++)
+                if (region[i] > ' ' && region[i] < 127)
+                    info |= (uint8_t)region[i] << (i*8);
+        f_close(&f);
+    } else if (CORE_ID == CORE_SNES && (strcasestr(name, ".sfc") || strcasestr(name, ".smc"))) {
+        // the header candidates are far apart, the link map saves the FAT walks
+        if (fast_open(&f, path))
+            return info;
+        int off = size & 0x3ff;
+        static const int pos[] = {0x7fc0, 0xffc0, 0x40ffc0};
+        int map_ctrl, rom_type_header, rom_size, ram_size, company;
+        for (int typ = 0; typ < 3; typ++)
+            if (parse_snes_header(&f, pos[typ] + off, size-off, typ, load_buf, &map_ctrl,
+                                  &rom_type_header, &rom_size, &ram_size, &company) == 0) {
+                info |= (map_ctrl & 0xff) | (rom_size & 0xff) << 8 | (ram_size & 0xff) << 16;
+                break;
+            }
+        fast_close(&f);
     }
-    // an entry to return to parent dir or main menu 
-    int is_root = dir[1] == '\0';
-    if (start == 0 && len > 0) {
-        if (is_root) {
-            strncpy(file_names[0], "<< Return to main menu", 256);
-            file_dir[0] = 0;
-        } else {
-            strncpy(file_names[0], "..", 256);
-            file_dir[0] = 1;
+    return info;
+}
+
+// fill in header info of the current listing from the index, parse the rest,
+// and write the index back if anything changed
+static void dir_index(char *dir) {
+    char path[32], name[256];
+    FIL f;
+    unsigned int br;
+    struct index_header h;
+    struct index_rec r;
+    int n = dir_cur->count;
+    int changed = 1;
+
+    index_path(dir, path);
+    if (f_open(&f, path, FA_READ) == FR_OK) {
+        if (f_read(&f, &h, sizeof(h), &br) == FR_OK && br == sizeof(h) && h.magic == INDEX_MAGIC &&
+            h.version == INDEX_VERSION && h.core_id == CORE_ID && strncmp(h.path, dir, 255) == 0) {
+            // both are in listing order, so walk them together
+            int i = 1;
+            changed = 0;
+            for (uint32_t k = 0; k < h.count; k++) {
+                if (f_read(&f, &r, INDEX_REC_SIZE, &br) || br != INDEX_REC_SIZE ||
+                    f_read(&f, name, r.name_len, &br) || br != r.name_len) {
+                    changed = 1;
+                    break;
+                }
+                name[r.name_len] = '\0';
+                int c = 1;
+                uint32_t rdir = r.dir ? DIR_IS_DIR : 0;
+                while (i < n && (c = dir_order(dir_entries[i].name & DIR_IS_DIR, dir_name(i), rdir, name)) < 0) {
+                    i++;                // new file
+                    changed = 1;
+                }
+                if (c != 0) {           // file is gone
+                    changed = 1;
+                    continue;
+                }
+                if (dir_entries[i].size == r.size && dir_entries[i].stamp == r.stamp)
+                    dir_entries[i].info = r.info;
+                else
+                    changed = 1;
+                i++;
+            }
+            if (i < n)
+                changed = 1;
         }
-        file_len++;
+        f_close(&f);
     }
-    cnt++;
 
-    // generate all file entries
+    // parse headers of new and changed ROMs
+    int todo = 0, done = 0;
+    for (int i = 1; i < n; i++)
+        if (!(dir_entries[i].name & DIR_IS_DIR) && !(dir_entries[i].info & INFO_VALID))
+            todo++;
+    for (int i = 1; i < n; i++) {
+        struct dir_entry *e = &dir_entries[i];
+        if ((e->name & DIR_IS_DIR) || (e->info & INFO_VALID))
+            continue;
+        if (todo > 16 && (done & 15) == 0) {
+            status("Indexing ");
+            printf("%d/%d", done, todo);
+        }
+        e->info = rom_info(dir, dir_name(i), e->size);
+        done++;
+    }
+    if (!changed)
+        return;
+
+    // write the new index, its directory is hidden from the menu
+    FILINFO fno;
+    if (f_stat(INDEX_DIR, &fno) != FR_OK) {
+        if (f_mkdir(INDEX_DIR) != FR_OK)
+            return;
+        f_chmod(INDEX_DIR, AM_HID, AM_HID);
+    }
+    if (f_open(&f, path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+        return;
+    h.magic = INDEX_MAGIC;
+    h.version = INDEX_VERSION;
+    h.core_id = CORE_ID;
+    h.count = 0;
+    for (int i = 1; i < n; i++)
+        if (strlen(dir_name(i)) < 256)
+            h.count++;
+    memset(h.path, 0, sizeof(h.path));
+    strncpy(h.path, dir, 255);
+    int ok = f_write(&f, &h, sizeof(h), &br) == FR_OK;
+    for (int i = 1; ok && i < n; i++) {
+        char *nm = dir_name(i);
+        int len = strlen(nm);
+        if (len >= 256)
+            continue;
+        r.size = dir_entries[i].size;
+        r.stamp = dir_entries[i].stamp;
+        r.info = dir_entries[i].info;
+        r.dir = (dir_entries[i].name & DIR_IS_DIR) != 0;
+        r.name_len = len;
+        ok = f_write(&f, &r, INDEX_REC_SIZE, &br) == FR_OK && f_write(&f, nm, len, &br) == FR_OK;
+    }
+    f_close(&f);
+    if (!ok)
+        f_unlink(path);
+    DEBUG("dir_index: %s, %d parsed, written to %s\n", dir, done, path);
+}
+
+// first letter of an entry, for jumping through the listing
+static int dir_letter(int i) {
+    return tolower(dir_name(i)[0]) | (dir_entries[i].name & DIR_IS_DIR ? 0x100 : 0);
+}
+
+// entry that starts the next (or previous) first letter from entry i
+static int dir_jump(int i, int next) {
+    int n = dir_cur->count;
+    if (n <= 1)
+        return 0;
+    if (i < 1)
+        return next ? 1 : 0;
+    int l = dir_letter(i);
+    if (next) {
+        int j = i;
+        while (j < n && dir_letter(j) == l)
+            j++;
+        return j < n ? j : i;
+    }
+    int j = i;
+    while (j > 1 && dir_letter(j-1) == l)
+        j--;
+    if (j == i && j > 1) {          // already at the start, go to the previous group
+        l = dir_letter(--j);
+        while (j > 1 && dir_letter(j-1) == l)
+            j--;
+    }
+    return j;
+}
+
+// make the listing of dir current, reading it from the card if not cached
+// return: 0 if successful
+static int dir_scan(char *dir) {
+    if (sd_ready())
+        return 99;
+    int slot = 0;
+    for (int i = 0; i < DIR_SLOTS; i++) {
+        struct dir_slot *d = &dir_slots[i];
+        if (d->count >= 0 && d->generation == disk_generation && strcmp(dir, d->path) == 0) {
+            dir_select(i);
+            return 0;
+        }
+        if (d->used < dir_slots[slot].used)     // least recently used
+            slot = i;
+    }
+
+    DIR d;
+    if (f_opendir(&d, dir) != 0)
+        return -1;
+    PROF_BEGIN("dir_scan");
+    dir_select(slot);
+    dir_cur->count = 0;
+    uint32_t bytes = 0;
+    if (dir[1] == '\0')
+        dir_add(&bytes, "<< Return to main menu", 0, 0, 0);
+    else
+        dir_add(&bytes, "..", DIR_IS_DIR, 0, 0);
+
     FILINFO fno;
     while (f_readdir(&d, &fno) == FR_OK) {
         if (fno.fname[0] == 0)
@@ -257,23 +592,119 @@ int load_dir(char *dir, int start, int len, int *count) {
         if ((fno.fattrib & AM_HID) || (fno.fattrib & AM_SYS))
              // skip hidden and system files
             continue;
-        if (cnt >= start && file_len < len) {
-            strncpy(file_names[file_len], fno.fname, 256);
-            file_dir[file_len] = fno.fattrib & AM_DIR;
-            file_sizes[file_len] = fno.fsize;
-            file_len++;
-            DEBUG("%s\n", fno.fname);
+        if (dir_cur->count == DIR_MAX || bytes + strlen(fno.fname) + 1 > DIR_NAMES_SIZE) {
+            LOG_WARN("dir_scan: %s has too many files\n", dir);
+            break;
         }
-        cnt++;
+        dir_add(&bytes, fno.fname, fno.fattrib & AM_DIR ? DIR_IS_DIR : 0, fno.fsize,
+                (uint32_t)fno.fdate << 16 | fno.ftime);
     }
     f_closedir(&d);
-    *count = cnt;
-    DEBUG("load_dir: count=%d\n", cnt);
+    dir_sort();
+    dir_index(dir);
+    PROF_END("dir_scan");
+    strncpy(dir_cur->path, dir, PWD_SIZE);
+    dir_cur->generation = disk_generation;
+    DEBUG("dir_scan: %s, %d entries, %d bytes of names\n", dir, dir_cur->count, bytes);
     return 0;
 }
 
+// starting from `start`, load `len` file names into file_names, 
+// file_dir. 
+// *count is set to number of all valid entries and `file_len` is
+// set to valid entries on this page.
+// return: 0 if successful
+int load_dir(char *dir, int start, int len, int *count) {
+    DEBUG("load_dir: %s, start=%d, len=%d\n", dir, start, len);
+    file_len = 0;
+    int r = dir_scan(dir);
+    if (r)
+        return r;
+    for (int i = start; i < dir_cur->count && file_len < len; i++) {
+        struct dir_entry *e = &dir_entries[i];
+        strncpy(file_names[file_len], dir_names + (e->name & ~DIR_IS_DIR), 256);
+        file_dir[file_len] = (e->name & DIR_IS_DIR) != 0;
+        file_sizes[file_len] = e->size;
+        file_len++;
+    }
+    *count = dir_cur->count;
+    DEBUG("load_dir: count=%d\n", dir_cur->count);
+    return 0;
+}
+
+// page number and header info of the entry under the cursor
+static void menu_status(int page, int pages, int idx) {
+    status("Page ");
+    printf("%d/%d", page+1, pages);
+    struct dir_entry *e = &dir_entries[idx];
+    if (idx == 0 || (e->name & DIR_IS_DIR) || !(e->info & ~INFO_VALID))
+        return;
+    print("  ");
+    if (CORE_ID == CORE_MD) {
+        for (int i = 0; i < 3; i++)
+            if (e->info >> (i*8) & 0xff)
+                putchar(e->info >> (i*8) & 0xff);
+    } else if (CORE_ID == CORE_SNES) {
+        int mc = e->info & 0xff;
+        print((mc & 3) == 1 ? "HiROM" : (mc & 3) == 2 ? "ExHiROM" : "LoROM");
+        printf(" %dKB", 1 << ((e->info >> 8) & 0xff));
+    }
+}
+
+// find a file by name prefix: UP/DOWN choose a letter, RIGHT goes to the next
+// letter, LEFT to the previous one, A/B searches.
+// return: index of the first entry starting with the prefix, -1 if none
+static int menu_search() {
+    static const char letters[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 -_.!'(&";
+    const int nl = sizeof(letters) - 1;
+    char prefix[32];
+    int len = 0, c = 0;
+    while (1) {
+        status("Find: ");
+        for (int i = 0; i < len; i++)
+            putchar(prefix[i]);
+        putchar(letters[c]);
+        putchar('_');
+        delay(150);
+        int joy1, joy2, joy;
+        do {
+            joy_get(&joy1, &joy2);
+            joy = joy1 | joy2;
+            backup_process();
+        } while ((joy & 0x1f1) == 0);         // B, directions, A
+        if (joy & 0x10)                 // up
+            c = (c + nl - 1) % nl;
+        else if (joy & 0x20)            // down
+            c = (c + 1) % nl;
+        else if (joy & 0x80) {          // right
+            if (len < sizeof(prefix) - 2)
+                prefix[len++] = letters[c];
+        } else if (joy & 0x40) {        // left
+            if (len == 0)
+                return -1;
+            char *p = strchr(letters, prefix[--len]);
+            c = p ? p - letters : 0;
+        } else if (joy & 0x101)         // A or B
+            break;
+    }
+    prefix[len++] = letters[c];
+    prefix[len] = '\0';
+    for (int i = 1; i < dir_cur->count; i++) {
+        char *nm = dir_name(i);
+        int k = 0;
+        while (k < len && tolower(nm[k]) == tolower(prefix[k]))
+            k++;
+        if (k == len)
+            return i;
+    }
+    status("Not found");
+    delay(500);
+    return -1;
+}
+
 // return 0: user chose a ROM (*choice), 1: no choice made, -1: error
 // file chosen: pwd / file_name[*choice]
+// L/R jump to the previous/next first letter, X searches by name prefix.
 int menu_loadrom(int *choice) {
     int page = 0, pages, total;
     int active = 0;
@@ -284,10 +715,9 @@ int menu_loadrom(int *choice) {
         int r = load_dir(pwd, page*PAGESIZE, PAGESIZE, &total);
         if (r == 0) {
             pages = (total+PAGESIZE-1) / PAGESIZE;
-            status("Page ");
-            printf("%d/%d", page+1, pages);
             if (active > file_len-1)
                 active = file_len-1;
+            int shown = -1;
             for (int i = 0; i < PAGESIZE; i++) {
                 int idx = page*PAGESIZE + i;
                 cursor(2, i+TOPLINE);
@@ -299,6 +729,10 @@ int menu_loadrom(int *choice) {
             }
             delay(300);
             while (1) {
+                if (active != shown) {
+                    menu_status(page, pages, page*PAGESIZE + active);
+                    shown = active;
+                }
                 int r = joy_choice(TOPLINE, file_len, &active, OSD_KEY_CODE);
                 if (r == 1) {
                     if (strcmp(pwd, "/") == 0 && page == 0 && active == 0) {
@@ -350,6 +784,13 @@ int menu_loadrom(int *choice) {
                 } else if (r == 3 && page > 0) {
                     page--;
                     break;
+                } else if (r == 4 || r == 5 || r == 6) {
+                    int idx = r == 6 ? menu_search() : dir_jump(page*PAGESIZE + active, r == 5);
+                    if (idx >= 0) {
+                        page = idx / PAGESIZE;
+                        active = idx % PAGESIZE;
+                    }
+                    break;
                 }
             }
         } else {
@@ -361,27 +802,26 @@ int menu_loadrom(int *choice) {
 }
 
 uint8_t corebuf[256];
-uint32_t t_ready, t_flash, t_file, t_parse;
 
 void write_flash(uint8_t *corebuf, uint32_t addr, int cnt) {
-    uint32_t start = cycle_counter();
+    PROF_BEGIN("flash_write");
     // uart_printf("Writing %d bytes at %x\n", cnt, addr);
     if ((addr & 0xfff) == 0) {	// whole 4KB, erase sector first
-        uint32_t t = cycle_counter();
+        PROF_BEGIN("flash_wait");
         spiflash_ready();
-        t_ready += cycle_counter() - t;
+        PROF_END("flash_wait");
         spiflash_sector_erase(addr);
         // uart_printf("Sector erased\n");
     }
-    uint32_t t = cycle_counter();
+    PROF_BEGIN("flash_wait");
     spiflash_ready();
-    t_ready += cycle_counter() - t;
+    PROF_END("flash_wait");
     spiflash_page_program(addr, corebuf);
     if ((addr & 0xfff) == 0) {
         status("");
         printf("%d KB written", addr >> 10);
     }
-    t_flash += cycle_counter() - start;
+    PROF_END("flash_write");
     spiflash_ready();
 }
 
@@ -394,14 +834,13 @@ bool verify_flash(uint8_t *corebuf, uint32_t addr, int cnt) {
     // uart_print("Done with flash read\n");
     for (int j = 0; j < cnt; j++) {
         if (buf[j] != corebuf[j]) {
-            uart_printf("Verify error at %x: %d != %d. Data read:\n", addr+j, buf[j], corebuf[j]);
+            LOG_ERROR("Verify error at %x: %d != %d. Data read:\n", addr+j, buf[j], corebuf[j]);
             for (int i = 0; i < 256; i++) {
                 if (i > 0 && i % 16 == 0)
-                    uart_print("\n");
-                uart_print_hex_digits(buf[i], 2);
-                uart_print(" ");
+                    LOG_ERROR("\n");
+                LOG_ERROR("%b ", buf[i]);
             }
-            uart_print("\n");
+            LOG_ERROR("\n");
             return false;
         }
     }
@@ -445,11 +884,10 @@ static char line_buf[4096];         // .fs file has max 3.5K lines
 void load_core(char *fname, int verify) {
     FIL f;
     int binfile = strcasestr(fname, ".bin") != NULL;      // 1: bin        
-    t_ready = 0; t_flash = 0, t_file = 0; t_parse = 0;
     if (binfile)
-        uart_printf("Loading bin file: %s\n", fname);
+        LOG_INFO("Loading bin file: %s\n", fname);
     else
-        uart_printf("Loading fs file: %s\n", fname);
+        LOG_INFO("Loading fs file: %s\n", fname);
     if (verify && !binfile) {
         message("Verify only supported for .bin files", 1);
         return;
@@ -464,11 +902,9 @@ void load_core(char *fname, int verify) {
     unsigned int cnt = 0;
     while (!f_eof(&f) && (binfile || addr < 32*1024)) { // write only 32KB for .fs
         if (binfile) {
-            // uart_print("Checking cycles\n");
-            uint32_t t = cycle_counter();
-            // uart_print("Reading file\n");
+            PROF_BEGIN("core_file");
             f_read(&f, corebuf, 256, &cnt);
-            t_file += cycle_counter() - t;
+            PROF_END("core_file");
             if (verify) {
                 if (!verify_flash(corebuf, addr, cnt))
                     return;
@@ -477,19 +913,19 @@ void load_core(char *fname, int verify) {
             addr += cnt;
             cnt = 0;
         } else {        // parse .fs file
-            uint32_t t = cycle_counter();
             if (f_eof(&f)) continue;
+            PROF_BEGIN("core_file");
             int len = 4096;
             read_line(&f, line_buf, &len);
             // message(line_buf, 0);
-            t_file += cycle_counter() - t;
+            PROF_END("core_file");
             if (s[0] == '/' && s[1] == '/') {
                 // comment, skip the whole line
                 continue;
             }
             for (int i = 0; i+8 <= len; i+=8) {	// add a byte to buf
-                uint32_t t2 = cycle_counter();
                 if (s[i] > '1' || s[i] < '0') break;
+                PROF_BEGIN("core_parse");
                 uint8_t b = ((s[i]-'0') << 7) + ((s[i+1]-'0') << 6) +
                         ((s[i+2]-'0') << 5) + ((s[i+3]-'0') << 4) +
                         ((s[i+4]-'0') << 3) + ((s[i+5]-'0') << 2) +
@@ -498,19 +934,15 @@ void load_core(char *fname, int verify) {
                 if (cnt < 16) {
                     char ss[9];
                     strncpy(ss, s+i, 9);
-                    uart_printf("[%s]=", ss);
-                    uart_print_hex_digits(b, 2);
-                    uart_print(" ");
+                    LOG_DEBUG("[%s]=%b ", ss, b);
                 }
                 cnt++;
-                t_parse += cycle_counter() - t2;
+                PROF_END("core_parse");
                 if (cnt == 256) {				// write a page
-                    uart_printf("Writing at %x:", addr);
-                    for (int j = 0; j < 16; j++) {
-                        uart_print_hex_digits(corebuf[j], 2);
-                        uart_print(" ");
-                    }
-                    uart_print("\n");
+                    LOG_DEBUG("Writing at %x:", addr);
+                    for (int j = 0; j < 16; j++)
+                        LOG_DEBUG("%b ", corebuf[j]);
+                    LOG_DEBUG("\n");
                     write_flash(corebuf, addr, cnt);
                     addr += cnt;
                     cnt = 0;
@@ -526,9 +958,7 @@ void load_core(char *fname, int verify) {
     spiflash_write_disable();
     f_close(&f);
 
-    const uint32_t MS = 21500;
-    uart_printf("File read cycles: %d, parse cycles: %d, flash total cycles: %d, flash wait cycles: %d\n", t_file, t_parse, t_flash, t_ready);
-    uart_printf("File read time: %d ms, parse time: %d ms, flash total time: %d ms, flash wait time: %d ms\n", t_file / MS, t_parse / MS, t_flash / MS, t_ready / MS);
+    prof_report(0);
     if (verify)
         message("Core matches", 1);
     else
@@ -601,7 +1031,7 @@ void _menu_select_core() {
 
 void menu_options() {
     int choice = 0;
-    uart_print("options\n");
+    LOG_DEBUG("options\n");
     while (1) {
         clear();
         cursor(8, 10);
@@ -653,6 +1083,25 @@ void menu_options() {
     }
 }
 
+// show profiling zones on OSD and UART
+void menu_profile() {
+    clear();
+    prof_report(1);
+    status("A/B: back, SELECT: reset");
+    delay(300);
+    for (;;) {
+        int joy1, joy2;
+        joy_get(&joy1, &joy2);
+        if ((joy1 | joy2) & 0x4) {      // SELECT
+            prof_reset();
+            break;
+        }
+        if ((joy1 & 0x1) || (joy1 & 0x100) || (joy2 & 0x1) || (joy2 & 0x100))
+            break;
+    }
+    delay(300);
+}
+
 int in_game;
 
 // return 0 if snes header is successfully parsed at off
@@ -728,10 +1177,9 @@ int loadsnes(int rom) {
     strncpy(core_backup_name, file_names[rom], base_len);
     strcpy(core_backup_name+base_len, ".srm");
 
-    // initiaze sd again to be sure
-    if (sd_init() != 0) return 99;
+    if (sd_ready()) return 99;
 
-    r = f_open(&f, load_fname, FA_READ);
+    r = fast_open(&f, load_fname);
     if (r) {
         status("Cannot open file");
         goto loadsnes_end;
@@ -773,12 +1221,17 @@ int loadsnes(int rom) {
         goto loadsnes_snes_end;
     }
     do {
-        if ((r = f_read(&f, load_buf, 1024, &br)) != FR_OK)
+        PROF_BEGIN("f_read");
+        r = f_read(&f, load_buf, 1024, &br);
+        PROF_END("f_read");
+        if (r != FR_OK)
             break;
+        PROF_BEGIN("core_data");
         for (int i = 0; i < br; i += 4) {
             uint32_t *w = (uint32_t *)(load_buf + i);
             core_data(*w);				// send actual ROM data
         }
+        PROF_END("core_data");
         total += br;
         if ((total & 0xffff) == 0) {	// display progress every 64KB
             status("");
@@ -807,7 +1260,7 @@ int loadsnes(int rom) {
 loadsnes_snes_end:
     core_ctrl(0);	// turn off game loading, this starts SNES
 loadsnes_close_file:
-    f_close(&f);
+    fast_close(&f);
 loadsnes_end:
     return r;
 }
@@ -830,10 +1283,9 @@ int loadnes(int rom) {
         goto loadnes_end;
     }
 
-    // initiaze sd again to be sure
-    if (sd_init() != 0) return 99;
+    if (sd_ready()) return 99;
 
-    r = f_open(&f, load_fname, FA_READ);
+    r = fast_open(&f, load_fname);
     if (r) {
         status("Cannot open file");
         goto loadnes_end;
@@ -851,12 +1303,17 @@ int loadnes(int rom) {
         goto loadnes_snes_end;
     }
     do {
-        if ((r = f_read(&f, load_buf, 1024, &br)) != FR_OK)
+        PROF_BEGIN("f_read");
+        r = f_read(&f, load_buf, 1024, &br);
+        PROF_END("f_read");
+        if (r != FR_OK)
             break;
+        PROF_BEGIN("core_data");
         for (int i = 0; i < br; i += 4) {
             uint32_t *w = (uint32_t *)(load_buf + i);
             core_data(*w);				// send actual ROM data
         }
+        PROF_END("core_data");
         total += br;
         if ((total & 0xfff) == 0) {	// display progress every 4KB
             status("");
@@ -872,7 +1329,7 @@ int loadnes(int rom) {
 
 loadnes_snes_end:
     core_ctrl(0);   // turn off game loading, this starts the core
-    f_close(&f);
+    fast_close(&f);
 loadnes_end:
     return r;
 }
@@ -895,21 +1352,26 @@ void gba_load_bios() {
     FIL f;
     int r = 1;
     unsigned br;
-    if (f_open(&f, "/gba_bios.bin", FA_READ) != FR_OK) {
+    if (fast_open(&f, "/gba_bios.bin") != FR_OK) {
         message("Cannot open /gba_bios.bin", 1);
         return;
     }
     core_ctrl(4);
     do {
-        if ((r = f_read(&f, load_buf, 1024, &br)) != FR_OK)
+        PROF_BEGIN("f_read");
+        r = f_read(&f, load_buf, 1024, &br);
+        PROF_END("f_read");
+        if (r != FR_OK)
             break;
+        PROF_BEGIN("core_data");
         for (int i = 0; i < br; i += 4) {
             uint32_t w = *(uint32_t *)(load_buf + i);
             core_data(w);
         }
+        PROF_END("core_data");
     } while (br == 1024);
 
-    f_close(&f);
+    fast_close(&f);
     gba_bios_loaded = 1;
     DEBUG("gba_load_bios end\n");
 }
@@ -936,10 +1398,9 @@ int loadgba(int rom) {
     strncpy(core_backup_name, file_names[rom], base_len);
     strcpy(core_backup_name+base_len, ".srm");
 
-    // initiaze sd again to be sure
-    if (sd_init() != 0) return 99;
+    if (sd_ready()) return 99;
 
-    r = f_open(&f, load_fname, FA_READ);
+    r = fast_open(&f, load_fname);
     if (r) {
         status("Cannot open file");
         goto loadgba_end;
@@ -959,8 +1420,12 @@ int loadgba(int rom) {
     int detect = 0; // 1: past 'EEPR', 2: past 'FLAS', 3: past 'SRAM'
     gba_backup_type = GBA_BACKUP_NONE;
     do {
-        if ((r = f_read(&f, load_buf, 1024, &br)) != FR_OK)
+        PROF_BEGIN("f_read");
+        r = f_read(&f, load_buf, 1024, &br);
+        PROF_END("f_read");
+        if (r != FR_OK)
             break;
+        PROF_BEGIN("core_data");
         for (int i = 0; i < br; i += 4) {
             uint32_t w = *(uint32_t *)(load_buf + i);
             core_data(w);				// send actual ROM data
@@ -1007,6 +1472,7 @@ int loadgba(int rom) {
                 }
             }
         }
+        PROF_END("core_data");
 
         total += br;
         if ((total & 0xffff) == 0) {	// display progress every 64KB
@@ -1058,13 +1524,90 @@ int loadgba(int rom) {
 
 loadgba_close:
     core_ctrl(0);   // turn off game loading, this starts the core
-    f_close(&f);
+    fast_close(&f);
 loadgba_end:
     return r;
 }
 
 
+// MD ROMs are read in large chunks so FatFs can fetch contiguous sectors with one
+// multi-block SD read
+#define MD_CHUNK 16384
+uint32_t md_buf[MD_CHUNK/4];
+
+static uint32_t stream_done, stream_shown, stream_size;
+
+static void stream_progress(uint32_t done) {
+    uint32_t total = stream_done + done;
+    if ((total >> 16) != (stream_shown >> 16)) {    // display progress every 64KB
+        stream_shown = total;
+        status("");
+        printf("%d/%dK", total >> 10, stream_size >> 10);
+    }
+}
+
+// Send a whole file to the core with sdhost stream reads, one CMD18 per run of
+// contiguous clusters from the link map of fast_open(). The CPU does not touch
+// the data.
+// return 1: done, 0: not possible (SPI mode or no link map) and nothing was
+// sent, -1: read error after some data was sent
+static int stream_file(FIL *f, uint32_t size) {
+    DWORD *clmt = f->cltbl;
+    if (!sdn_active() || clmt == NULL)
+        return 0;
+    FATFS *fs = f->obj.fs;
+    uint32_t cluster_bytes = fs->csize * 512;
+    stream_done = stream_shown = 0;
+    stream_size = size;
+    for (DWORD *p = clmt + 1; p[0] && stream_done < size; p += 2) {
+        uint32_t len = size - stream_done;
+        if (p[0] < len / cluster_bytes + 1)
+            len = p[0] * cluster_bytes;
+        LBA_t sector = fs->database + (LBA_t)fs->csize * (p[1] - 2);
+        if (!sdn_stream(sector, len, stream_progress))
+            return -1;
+        stream_done += len;
+    }
+    return stream_done == size ? 1 : -1;
+}
+
+// Optional database of known good ROMs, lines of "<CRC-32 in hex> <name>"
+#define ROMDB_FILE "/romdb.txt"
+
+// look up crc in ROMDB_FILE
+// return 1: found and name is set, 0: not found, -1: no database
+static int romdb_lookup(uint32_t crc, char *name, int len) {
+    FIL f;
+    char line[256];
+    int r = 0;
+    if (f_open(&f, ROMDB_FILE, FA_READ) != FR_OK)
+        return -1;
+    while (f_gets(line, sizeof(line), &f)) {
+        uint32_t c = 0;
+        char *p = line;
+        for (; *p; p++) {
+            int d = tolower(*p);
+            if (d >= '0' && d <= '9')
+                c = c << 4 | (d - '0');
+            else if (d >= 'a' && d <= 'f')
+                c = c << 4 | (d - 'a' + 10);
+            else
+                break;
+        }
+        if (p == line || c != crc)
+            continue;
+        strncpy(name, trimwhitespace(p), len - 1);
+        name[len - 1] = '\0';
+        r = 1;
+        break;
+    }
+    f_close(&f);
+    return r;
+}
+
 // load a MD/Genesis rom file.
+// The CRC-32 and the header checksum are computed by romcrc.v as the data goes
+// to the core, and checked after loading.
 // return 0 if successful
 int loadmd(int rom) {
     FIL f;
@@ -1082,10 +1625,9 @@ int loadmd(int rom) {
         goto loadmd_end;
     }
 
-    // initiaze sd again to be sure
-    if (sd_init() != 0) return 99;
+    if (sd_ready()) return 99;
 
-    r = f_open(&f, load_fname, FA_READ);
+    r = fast_open(&f, load_fname);
     if (r) {
         status("Cannot open file");
         goto loadmd_end;
@@ -1093,66 +1635,170 @@ int loadmd(int rom) {
     unsigned int off = 0, br, total = 0;
     unsigned int size = file_sizes[rom];
 
+    // header checksum: sum of the big-endian words after the 512-byte header
+    uint8_t *hdr = (uint8_t *)load_buf;
+    int has_header = f_read(&f, hdr, 0x200, &br) == FR_OK && br == 0x200;
+    uint16_t header_sum = hdr[0x18e] << 8 | hdr[0x18f];
+
     // load actual ROM
     core_ctrl(1);		// enable game loading, this resets the core
     core_running = false;
+    reg_romcrc_crc = 0;     // reset the checksums
+    reg_romcrc_sum = 0x200;
 
     // Send rom content to core
     if ((r = f_lseek(&f, off)) != FR_OK) {
         status("Seek failure");
         goto loadmd_close_file;
     }
-    do {
-        if ((r = f_read(&f, load_buf, 1024, &br)) != FR_OK)
+    // with the native SD host, the data goes from the card to the core directly
+    PROF_BEGIN("sd_stream");
+    int s = stream_file(&f, size);
+    PROF_END("sd_stream");
+    if (s > 0)
+        total = size;
+    else if (s < 0) {
+        status("SD read error");
+        r = FR_DISK_ERR;
+        goto loadmd_close_file;
+    } else do {
+        PROF_BEGIN("f_read");
+        r = f_read(&f, md_buf, MD_CHUNK, &br);
+        PROF_END("f_read");
+        if (r != FR_OK)
             break;
         if (br % 4 != 0) {
-            uart_printf("WARNING: file size is not multiple of 4, br=%d\n", br);
+            LOG_WARN("WARNING: file size is not multiple of 4, br=%d\n", br);
             break;
         }
-        for (int i = 0; i < br; i += 4) {
-            uint32_t *w = (uint32_t *)(load_buf + i);
-            core_data(*w);				// send actual ROM data
-        }
+        PROF_BEGIN("core_data");
+        for (int i = 0; i < br / 4; i++)
+            core_data(md_buf[i]);			// send actual ROM data
+        PROF_END("core_data");
         total += br;
-        if ((total & 0xfff) == 0) {	// display progress every 4KB
+        if ((total & 0xffff) == 0) {	// display progress every 64KB
             status("");
             printf("%d/%dK", total >> 10, size >> 10);
         }
-    } while (br == 1024);
+    } while (br == MD_CHUNK);
 
     DEBUG("loadmd: %d bytes\n", total);
+    uint32_t crc = reg_romcrc_crc;
+    uint16_t sum = reg_romcrc_sum;
+    char name[64];
+    int db = romdb_lookup(crc, name, sizeof(name));
+    LOG_INFO("loadmd: CRC-32 %x, checksum %x, header %x\n", crc, sum, header_sum);
+    if (db == 1)
+        LOG_INFO("loadmd: %s\n", name);
     status("Success");
+    if (has_header)
+        print(sum == header_sum ? ", checksum OK" : ", bad checksum");
+    if (db >= 0)
+        print(db ? ", in ROM db" : ", not in ROM db");
     core_running = true;
 
     overlay(0);		// turn off OSD
 
 loadmd_close_file:
     core_ctrl(0);   // turn off game loading, this starts the core
-    f_close(&f);
+    fast_close(&f);
 loadmd_end:
     return r;
 }
 
+// Save files are allocated contiguously once (f_expand), then overwritten in
+// place: backup_save() writes the data sectors at save_lba, without touching
+// the FAT or the directory entry.
+static LBA_t save_lba;              // 0: not known, write through FatFs
+static DWORD save_generation;       // disk_generation of save_lba
+
+// remember where the save file starts, if it has size bytes in one run of clusters
+static void save_locate(FIL *f, DWORD sclust, int size) {
+    save_lba = 0;
+    if (f_size(f) != size || size % 512 || sclust < 2 || sclust >= fs.n_fatent)
+        return;
+    save_lba = fs.database + (LBA_t)fs.csize * (sclust - 2);
+    save_generation = disk_generation;
+    DEBUG("save file at sector %d\n", save_lba);
+}
+
+// Pages of 512 bytes written by the core and not saved yet. The hardware
+// bitmap (reg_cartram_pages) is read and cleared into this, so pages stay
+// dirty here until a save succeeds. Without the bitmap (the core does not
+// report its writes), any change marks all pages: the reg_cartram_dirty flag
+// for GBA, a CRC of BSRAM for the others.
+#define SAVE_PAGE_WORDS 8               // 256 pages, 128KB
+static uint32_t save_dirty[SAVE_PAGE_WORDS];
+static uint16_t save_crc16;             // of BSRAM, without the bitmap and flag
+
+static inline int save_page_dirty(int p) {
+    return save_dirty[p >> 5] >> (p & 31) & 1;
+}
+
+// collect dirty pages from the hardware, return the number of dirty pages
+static int save_collect(uint8_t *bsram, int size) {
+    int pages = size / 512, n = 0;
+    int changed = 0;
+    if (reg_cartram_dirty & CARTRAM_PRESENT) {
+        for (int w = 0; w < SAVE_PAGE_WORDS && w * 32 < pages; w++) {
+            reg_cartram_pages = w;
+            save_dirty[w] |= reg_cartram_pages;
+        }
+    } else if (CORE_ID == CORE_GBA) {
+        changed = reg_cartram_dirty != 0;
+        reg_cartram_dirty = 0;
+    } else {
+        uint16_t crc = gen_crc16(bsram, size);
+        changed = crc != save_crc16;
+        save_crc16 = crc;
+    }
+    if (changed)
+        memset(save_dirty, 0xff, sizeof(save_dirty));
+    for (int p = 0; p < pages; p++)
+        n += save_page_dirty(p);
+    return n;
+}
+
+// write the dirty pages to the save file at save_lba, in runs of sectors
+static int save_write_dirty(uint8_t *bsram, int size) {
+    int pages = size / 512;
+    for (int p = 0; p < pages; ) {
+        if (!save_page_dirty(p)) {
+            p++;
+            continue;
+        }
+        int n = 1;
+        while (p + n < pages && save_page_dirty(p + n))
+            n++;
+        if (disk_write(0, bsram + p * 512, save_lba + p, n) != RES_OK)
+            return 0;
+        p += n;
+    }
+    return disk_ioctl(0, CTRL_SYNC, 0) == RES_OK;
+}
+
 void backup_load(char *name, int size) {
     core_backup_valid = false;
+    save_lba = 0;
     if (!option_backup_bsram || size == 0) return;
     char path[266] = "/saves/";
     FILINFO fno;
     uint8_t *bsram = (uint8_t *)0x700000;			// directly read into BSRAM
 
     if (f_stat(path, &fno) != FR_OK) {
+        dir_cache_drop("/");
         if (f_mkdir(path) != FR_OK) {
             status("Cannot create /saves");
-            uart_printf("Cannot create /saves\n");
+            LOG_ERROR("Cannot create /saves\n");
             goto backup_load_crc;
         }
     }
     strcat(path, core_backup_name);
-    uart_printf("Loading save file from: %s\n", core_backup_name);
+    LOG_INFO("Loading save file from: %s\n", core_backup_name);
     FIL f;
-    if (f_open(&f, path, FA_READ) != FR_OK) {
+    if (fast_open(&f, path) != FR_OK) {
         core_backup_valid = true;					// new save file, mark as valid
-        uart_printf("Cannot open save file, assuming new\n");
+        LOG_INFO("Cannot open save file, assuming new\n");
         goto backup_load_crc;
     }
     uint8_t *p = bsram;	
@@ -1165,16 +1811,18 @@ void backup_load(char *name, int size) {
         load += br;
     }
     core_backup_valid = true;
-    f_close(&f);
-    uart_printf("Save file loaded\n", load);
+    // with a single fragment in the link map, later saves can go in place
+    if (f.cltbl && f.cltbl[1] * fs.csize * 512 >= size)
+        save_locate(&f, f.cltbl[2], size);
+    fast_close(&f);
+    LOG_INFO("Save file loaded\n");
 
 backup_load_crc:
-    if (CORE_ID == CORE_SNES) {
-        snes_bsram_crc16 = gen_crc16(bsram, size);
-        uart_printf("CRC16: %x\n", snes_bsram_crc16);
-    }
-    if (CORE_ID == CORE_GBA)
-        reg_cartram_dirty = 0;
+    // BSRAM now matches the save file
+    reg_cartram_dirty = 0;
+    memset(save_dirty, 0, sizeof(save_dirty));
+    if (CORE_ID != CORE_GBA)
+        save_crc16 = gen_crc16(bsram, size);
 
     return;
 }
@@ -1187,53 +1835,64 @@ int backup_save(char *name, int size) {
     uint8_t *bsram = (uint8_t *)0x700000;		// directly read from BSRAM
     int r = 0;
 
-    uart_printf("backup_save: start\n");
+    LOG_DEBUG("backup_save: start\n");
+    PROF_BEGIN("backup_save");
 
-    // first check if BSRAM content is changed since last save
-    if (CORE_ID == CORE_SNES) {
-        // SNES uses CRC check
-        int newcrc = gen_crc16(bsram, size);
-        uart_printf("New CRC: %x, size=%d\n", newcrc, size);
-        if (newcrc == snes_bsram_crc16) {
-            r = 1;
-            goto save_end;
-        }
-        snes_bsram_crc16 = newcrc;
-    } else {
-        // GBA uses dirty flag
-        if (reg_cartram_dirty == 0) {
-            r = 1;
-            uart_printf("Save data not changed\n");
-            goto save_end;
-        }
-        uart_printf("Save data CHANGED\n");
-        reg_cartram_dirty = 0;
+    // first check which pages of BSRAM changed since last save
+    int dirty = save_collect(bsram, size);
+    if (dirty == 0) {
+        r = 1;
+        LOG_DEBUG("Save data not changed\n");
+        goto save_end;
+    }
+    LOG_INFO("Save data CHANGED, %d sectors\n", dirty);
+
+    // overwrite the dirty sectors in place
+    if (save_lba && save_generation == disk_generation) {
+        LOG_INFO("Writing save file in place: %s\n", core_backup_name);
+        if (save_write_dirty(bsram, size))
+            goto save_done;
+        LOG_WARN("In-place write failed, writing through FatFs\n");
+        save_lba = 0;
     }
 
     strcat(path, core_backup_name);
+    dir_cache_drop("/saves");
     if (f_open(&f, path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
         status("Cannot write save file");
-        uart_printf("Cannot write save file");
+        LOG_ERROR("Cannot write save file\n");
         r = 2;
         goto save_end;
     }
+    // allocate the clusters contiguously, so the next saves can go in place
+    int expanded = f_expand(&f, size, 1) == FR_OK;
+    if (!expanded)
+        LOG_WARN("No contiguous space for the save file\n");
     unsigned int bw;
     // for (int off = 0; off < size; off += bw) {
     // 	if (f_write(&f, bsram, 1024, &bw) != FR_OK) {
-    uart_printf("Writing save file to: %s, len=%d\n", core_backup_name, size);
+    LOG_INFO("Writing save file to: %s, len=%d\n", core_backup_name, size);
     if (f_write(&f, bsram, size, &bw) != FR_OK || bw != size) {
         status("Write failure");
-        uart_printf("Write failure, bw=%d\n", bw);
+        LOG_ERROR("Write failure, bw=%d\n", bw);
         r = 2;
         goto bsram_save_close;
     }
     // }
+    if (expanded)
+        save_locate(&f, f.obj.sclust, size);
 
 bsram_save_close:
     f_close(&f);
+    if (r)
+        goto save_end;
+
+save_done:
+    memset(save_dirty, 0, sizeof(save_dirty));
 
 save_end:
-    uart_printf("backup_save: end\n");
+    PROF_END("backup_save");
+    LOG_DEBUG("backup_save: end\n");
     return r;
 }
 
@@ -1261,70 +1920,35 @@ void backup_process() {
     int t = time_millis();
     if (t - core_backup_time >= 10000) {                    // need to save
         // uart_printf("CHECK 4F4=%x\n", *(volatile uint32_t *)0x4f4);
-        uart_printf("Check backup: type=%d, size=%d\n", gba_backup_type, size);
+        LOG_DEBUG("Check backup: type=%d, size=%d\n", gba_backup_type, size);
         int r = backup_save(core_backup_name, size);
         // uart_printf("CHECK 4F4=%x\n", *(volatile uint32_t *)0x4f4);
         if (r == 0)
             backup_success_time = t;
         if (backup_success_time != 0) {
             status("");
-            printf("Backup saved to sdcard %ds ago ", (t-backup_success_time)/1000);
-            print_hex_digits(snes_bsram_crc16, 4);
+            printf("Backup saved to sdcard %ds ago", (t-backup_success_time)/1000);
         }
         core_backup_time = t;
     }
 }
 
-#define CRC16 0x8005
+// CRC-16/ARC (polynomial 0x8005, bits reversed), one table lookup per byte
+static uint16_t crc16_table[256];
 
 uint16_t gen_crc16(const volatile uint8_t *data, int size) {
-    uint16_t out = 0;
-    int bits_read = 0, bit_flag;
-
-    /* Sanity check: */
-    if(data == NULL)
+    if (data == NULL)
         return 0;
-
-    while(size > 0)
-    {
-        bit_flag = out >> 15;
-
-        /* Get next bit: */
-        out <<= 1;
-        out |= (*data >> bits_read) & 1; // item a) work from the least significant bits
-
-        /* Increment bit counter: */
-        bits_read++;
-        if(bits_read > 7)
-        {
-            bits_read = 0;
-            data++;
-            size--;
+    if (crc16_table[1] == 0)
+        for (int i = 0; i < 256; i++) {
+            uint16_t c = i;
+            for (int b = 0; b < 8; b++)
+                c = c & 1 ? (c >> 1) ^ 0xA001 : c >> 1;     // 0xA001 is 0x8005 reversed
+            crc16_table[i] = c;
         }
-
-        /* Cycle check: */
-        if(bit_flag)
-            out ^= CRC16;
-
-    }
-
-    // item b) "push out" the last 16 bits
-    int i;
-    for (i = 0; i < 16; ++i) {
-        bit_flag = out >> 15;
-        out <<= 1;
-        if(bit_flag)
-            out ^= CRC16;
-    }
-
-    // item c) reverse the bits
     uint16_t crc = 0;
-    i = 0x8000;
-    int j = 0x0001;
-    for (; i != 0; i >>=1, j <<= 1) {
-        if (i & out) crc |= j;
-    }
-
+    while (size-- > 0)
+        crc = (crc >> 8) ^ crc16_table[(crc ^ *data++) & 0xff];
     return crc;
 }
 
@@ -1335,25 +1959,15 @@ int main() {
     // initialize UART
     if (CORE_ID == 3) {     // GBA core uses 16.78Mhz clock
         reg_uart_clkdiv = 138; // 16777216 / 115200;
+        prof_cycles_per_ms = 16777;
     } else {
         reg_uart_clkdiv = 187; // 21505400 / 115200;
     }
 
-    sd_init();
-    delay(100);
     DEBUG("CORE_ID=%d\n", CORE_ID);
-    
-    int mounted = 0;
-    while(!mounted) {
-        for (int attempts = 0; attempts < 255; attempts++) {
-            if (f_mount(&fs, "", 0) == FR_OK) {
-                mounted = 1;
-                break;
-            }
-        }
-        if (!mounted)
-            message("Insert SD card and press any key", 1);
-    }
+
+    while (sd_ready())
+        message("Insert SD card and press any key", 1);
 
     int r = load_option();
     if (r == 2) {	// file corrupt
@@ -1386,8 +2000,9 @@ int main() {
         print("2) Select core\n");
         cursor(2, 14);
         print("3) Options\n");
-        // cursor(2, 15);
-        // print("4) Verify core\n");
+        cursor(2, 15);
+        print("4) Profiling report\n");
+        // print("5) Verify core\n");
         cursor(2, 16);
         print("Version: ");
         print(__DATE__);
@@ -1396,7 +2011,7 @@ int main() {
 
         int choice = 0;
         for (;;) {
-            int r = joy_choice(12, 3, &choice, OSD_KEY_CODE);
+            int r = joy_choice(12, 4, &choice, OSD_KEY_CODE);
             if (r == 1) break;
         }
 
@@ -1411,6 +2026,8 @@ int main() {
             menu_options();
             continue;
         } else if (choice == 3) {
+            menu_profile();
+        } else if (choice == 4) {
             menu_select_core(1);
         }
     }
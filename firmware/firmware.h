@@ -20,12 +20,20 @@ int loadsnes(int rom);
 int loadgba(int rom);
 int loadmd(int rom);
 
+// return 0 if snes header is successfully parsed at pos
+// typ 0: LoROM, 1: HiROM, 2: ExHiROM
+int parse_snes_header(FIL *fp, int pos, int file_size, int typ, char *hdr,
+                      int *map_ctrl, int *rom_type_header, int *rom_size,
+                      int *ram_size, int *company);
+
+// make sure the SD card is initialized and mounted, 0 if ready
+int sd_ready();
+
 void message(char *msg, int center);
 
 void status(char *msg);
 
-#define CRC16 0x8005
-
+// CRC-16/ARC, polynomial 0x8005
 uint16_t gen_crc16(const volatile uint8_t *data, int size);
 
 #endif
\ No newline at end of file
@@ -40,8 +40,12 @@ int putchar(int c)
    return c;
 }
 int uart_putchar(int c);
+int log_putchar(int c);
+// uart: 0 = OSD, 1 = UART, 2 = log buffer
 int _putchar(int c, int uart) {
-   if (uart)
+   if (uart == 2)
+      log_putchar(c);
+   else if (uart)
       uart_putchar(c);
    else
       putchar(c);
@@ -57,7 +61,10 @@ int print(const char *p)
 }
 int uart_print(const char *p);
 int _print(const char *p, int uart) {
-   if (uart)
+   if (uart == 2)
+      while (*p)
+         log_putchar(*(p++));
+   else if (uart)
       uart_print(p);
    else
       print(p);
@@ -160,6 +167,10 @@ int uart_print(const char *s) {
    return 0;
 }
 
+int uart_tx_busy() {
+   return reg_uart_clkdiv >> 31;
+}
+
 int uart_printf(const char *fmt,...) {
    va_list ap;
    va_start(ap, fmt);
@@ -168,6 +179,118 @@ int uart_printf(const char *fmt,...) {
    return 0;   
 }
 
+#define LOG_BUF_SIZE 4096           // power of 2
+
+char log_buf[LOG_BUF_SIZE];
+unsigned log_head, log_tail;        // write and read positions, free running
+unsigned log_dropped;               // characters lost because the buffer was full
+
+int log_putchar(int c) {
+   if (log_head - log_tail >= LOG_BUF_SIZE)
+      log_dropped++;
+   else
+      log_buf[log_head++ & (LOG_BUF_SIZE-1)] = c;
+   return c;
+}
+
+void log_poll() {
+   while (log_tail != log_head && !uart_tx_busy())
+      reg_uart_data = log_buf[log_tail++ & (LOG_BUF_SIZE-1)];
+}
+
+void log_flush() {
+   while (log_tail != log_head)
+      reg_uart_data = log_buf[log_tail++ & (LOG_BUF_SIZE-1)];   // waits for the UART
+   if (log_dropped) {
+      uart_printf("(%d log characters dropped)\n", log_dropped);
+      log_dropped = 0;
+   }
+}
+
+int log_printf(const char *fmt,...) {
+   va_list ap;
+   va_start(ap, fmt);
+   _printf(fmt, ap, 2);
+   va_end(ap);
+   log_poll();
+   return 0;
+}
+
+// profiling zones, the last entry collects zones beyond PROF_MAX
+struct prof_zone {
+   const char *name;
+   uint32_t count, min, max;
+   uint64_t total;
+} prof_zones[PROF_MAX+1];
+uint32_t prof_start[PROF_MAX+1];
+int prof_zone_cnt;
+int prof_cycles_per_ms = 21505;
+
+int prof_zone(const char *name) {
+   for (int i = 0; i < prof_zone_cnt; i++)
+      if (strcmp(prof_zones[i].name, name) == 0)
+         return i;
+   if (prof_zone_cnt == PROF_MAX) {
+      if (!prof_zones[PROF_MAX].name) {
+         prof_zones[PROF_MAX].name = "(other)";
+         prof_zones[PROF_MAX].min = 0xffffffff;
+      }
+      return PROF_MAX;
+   }
+   prof_zones[prof_zone_cnt].name = name;
+   prof_zones[prof_zone_cnt].min = 0xffffffff;
+   return prof_zone_cnt++;
+}
+
+void prof_add(int id, uint32_t cycles) {
+   struct prof_zone *z = &prof_zones[id];
+   z->count++;
+   z->total += cycles;
+   if (cycles < z->min) z->min = cycles;
+   if (cycles > z->max) z->max = cycles;
+}
+
+void prof_reset() {
+   for (int i = 0; i <= PROF_MAX; i++) {
+      prof_zones[i].count = 0;
+      prof_zones[i].total = 0;
+      prof_zones[i].min = 0xffffffff;
+      prof_zones[i].max = 0;
+   }
+}
+
+static int cycles_to_us(uint32_t c) {
+   return (uint64_t)c * 1000 / prof_cycles_per_ms;
+}
+
+void prof_report(int osd) {
+   log_flush();
+   uart_printf("zone            count min avg max (cycles) total(ms)\n");
+   if (osd) {
+      cursor(2, 2);
+      print("zone / count");
+      cursor(2, 3);
+      print("  min/avg/max (us)");
+   }
+   int line = 5;
+   for (int i = 0; i <= PROF_MAX; i++) {
+      struct prof_zone *z = &prof_zones[i];
+      if (z->count == 0) continue;
+      uint32_t avg = z->total / z->count;
+      int len = strlen(z->name);
+      uart_print(z->name);
+      for (int j = len; j < 16; j++)
+         uart_putchar(' ');
+      uart_printf("%d %d %d %d %d\n", z->count, z->min, avg, z->max, (uint32_t)(z->total / prof_cycles_per_ms));
+      if (osd && line < 26) {
+         cursor(2, line++);
+         printf("%s %d", z->name, z->count);
+         cursor(2, line++);
+         printf("  %d/%d/%d", cycles_to_us(z->min), cycles_to_us(avg), cycles_to_us(z->max));
+      }
+   }
+}
+
 // int delay_count;
 // void delay(int ms) {
 // 	for (int i = 0; i < ms; i++) {
@@ -180,7 +303,8 @@ int uart_printf(const char *fmt,...) {
 
 void delay(int ms) {
    int t0 = time_millis();
-   while (time_millis() - t0 < ms) {}
+   while (time_millis() - t0 < ms)
+      log_poll();
 }
 
 void joy_get(int *joy1, int *joy2) {
@@ -210,6 +334,7 @@ int joy_choice(int start_line, int len, int *active, int overlay_key_code) {
    }
 
    backup_process();                // saves backup every 10 seconds
+   log_poll();
 
    if (!overlay_status()) {         // stop responding when OSD is off
       // DEBUG("joy_choice: overlay off\n");
@@ -228,6 +353,12 @@ int joy_choice(int start_line, int len, int *active, int overlay_key_code) {
       return 2;      // next page
    if ((joy1 & 0x1) || (joy1 & 0x100) || (joy2 & 0x1) || (joy2 & 0x100))
       return 1;      // confirm
+   if ((joy1 & 0x400) || (joy2 & 0x400))
+      return 4;      // L
+   if ((joy1 & 0x800) || (joy2 & 0x800))
+      return 5;      // R
+   if ((joy1 & 0x200) || (joy2 & 0x200))
+      return 6;      // X
 
    cursor(0, start_line + (*active));
    print(">");
@@ -313,6 +444,17 @@ int strcmp(const char* s1, const char* s2)
    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
 }
 
+int strncmp(const char* s1, const char* s2, size_t n)
+{
+   for (; n > 0; n--, s1++, s2++) {
+      if (*s1 != *s2)
+         return *(const unsigned char*)s1 - *(const unsigned char*)s2;
+      if (*s1 == 0)
+         break;
+   }
+   return 0;
+}
+
 int strcasecmp(const char* s1, const char* s2) {
    while(*s1 && (tolower(*s1) == tolower(*s2))) {
       s1++;
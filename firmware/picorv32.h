@@ -5,14 +5,29 @@
 #include <string.h>
 #include <stdlib.h>     // for atoi()
 
-#define DEBUG(...) uart_printf(__VA_ARGS__)
-// #define DEBUG(...) do {} while(0)
+// Log levels. Messages above LOG_LEVEL compile away, e.g. make LOG_LEVEL=4 for debug output.
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG(level, ...) do { if ((level) <= LOG_LEVEL) log_printf(__VA_ARGS__); } while(0)
+#define LOG_ERROR(...) LOG(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...)  LOG(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...)  LOG(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define DEBUG(...) LOG_DEBUG(__VA_ARGS__)
 
 #define reg_textdisp       (*(volatile uint32_t*)0x02000000)
 #define reg_uart_clkdiv    (*(volatile uint32_t*)0x02000010)
 #define reg_uart_data      (*(volatile uint32_t*)0x02000014)
 #define reg_spimaster_byte (*(volatile uint32_t*)0x02000020)
 #define reg_spimaster_word (*(volatile uint32_t*)0x02000024)
+#define reg_spimaster_div  (*(volatile uint32_t*)0x02000028)
 #define reg_romload_ctrl   (*(volatile uint32_t*)0x02000030)
 #define reg_romload_data   (*(volatile uint32_t*)0x02000034)
 #define reg_joystick       (*(volatile uint32_t*)0x02000040)
@@ -23,6 +38,18 @@
 #define reg_spiflash_word  (*(volatile uint32_t*)0x02000074)
 #define reg_spiflash_ctrl  (*(volatile uint32_t*)0x02000078)
 #define reg_cartram_dirty  (*(volatile uint32_t*)0x02000080)
+#define reg_cartram_pages  (*(volatile uint32_t*)0x02000084)
+#define CARTRAM_PRESENT    0x80000000   // reg_cartram_dirty: page bitmap is there (CARTRAM_TRACK=1)
+#define reg_romcrc_crc     (*(volatile uint32_t*)0x02000088)
+#define reg_romcrc_sum     (*(volatile uint32_t*)0x0200008C)
+#define reg_spidma_addr    (*(volatile uint32_t*)0x02000090)
+#define reg_spidma_ctrl    (*(volatile uint32_t*)0x02000094)
+#define reg_sdhost_cmd     (*(volatile uint32_t*)0x020000A0)
+#define reg_sdhost_arg     (*(volatile uint32_t*)0x020000A4)
+#define reg_sdhost_resp    (*(volatile uint32_t*)0x020000A8)
+#define reg_sdhost_data    (*(volatile uint32_t*)0x020000AC)
+#define reg_sdhost_ctrl    (*(volatile uint32_t*)0x020000B0)
+#define reg_sdhost_stream  (*(volatile uint32_t*)0x020000B4)
 
 // Standard library for PicoRV32 RV32I softcore
 
@@ -48,21 +75,66 @@ extern void uart_print_hex_digits(uint32_t v, int n);
 extern void uart_print_dec(int v);
 extern int uart_print(const char *s);
 extern int uart_printf(const char *fmt,...);
+extern int uart_tx_busy();           // 1 while a character is being sent
+
+// logging: messages go into a RAM ring buffer and are sent when the UART is idle,
+// so callers never wait for the UART. Use the LOG_* macros above.
+extern int log_printf(const char *fmt,...);
+extern void log_poll();              // send buffered characters while the UART is idle, never blocks
+extern void log_flush();             // send everything, blocks
+
+// profiling zones
+// PROF_BEGIN("name") ... PROF_END("name") measures the cycles in between with reg_cycle and
+// accumulates count, min, avg and max per name. Zones can nest, but a zone must not be
+// re-entered before it ends. Build with PROFILE=0 to compile them away.
+#ifndef PROFILE
+#define PROFILE 1
+#endif
+#define PROF_MAX 16
+#if PROFILE
+#define PROF_BEGIN(name) do { static int _prof_id = -1; \
+        if (_prof_id < 0) _prof_id = prof_zone(name); \
+        prof_start[_prof_id] = reg_cycle; } while(0)
+#define PROF_END(name) do { static int _prof_id = -1; uint32_t _prof_t = reg_cycle; \
+        if (_prof_id < 0) _prof_id = prof_zone(name); \
+        prof_add(_prof_id, _prof_t - prof_start[_prof_id]); } while(0)
+#else
+#define PROF_BEGIN(name) do {} while(0)
+#define PROF_END(name) do {} while(0)
+#endif
+extern uint32_t prof_start[];
+extern int prof_cycles_per_ms;      // for converting to microseconds, set by main()
+extern int prof_zone(const char *name);     // zone id for name, created on first use
+extern void prof_add(int id, uint32_t cycles);
+extern void prof_report(int osd);   // print table to UART, and to OSD if osd != 0
+extern void prof_reset();
 
 // joystick input
 extern void joy_get(int *joy1, int *joy2);
 
 // display cursor and let user choose using joystick. 
 // this returns immediately
-// 0: no choice from user, 1: user chose *active, 2: next page, 3: previous page
+// 0: no choice from user, 1: user chose *active, 2: next page, 3: previous page,
+// 4: L, 5: R, 6: X button
 extern int joy_choice(int start_line, int len, int *active, int osd_key_code);
 
 // SD card access
 extern int sd_init();   /* Return 0 on success, non-zero on failure */
 extern uint8_t sd_send_command(uint8_t cmd, uint32_t arg);
+extern int sd_status();   /* CMD13, 0 if the card answers */
 extern int sd_readsector(uint32_t sector, uint8_t* buffer, uint32_t sector_count); /* 1:success, 0:failure*/
 extern int sd_writesector(uint32_t sector, const uint8_t* buffer, uint32_t sector_count); /* 1:success, 0:failure*/
 
+// SD card access in native 4-bit mode (sd_native.c), same conventions as above
+extern int sdn_init();
+extern int sdn_readsector(uint32_t sector, uint8_t* buffer, uint32_t sector_count);
+extern int sdn_writesector(uint32_t sector, const uint8_t* buffer, uint32_t sector_count);
+extern int sdn_active();     /* 1: card is in native mode */
+extern int sdn_status();     /* CMD13, 0 if the card answers and is in transfer state */
+// read len bytes from sector on straight into the core (romload), progress(done) is
+// called as data goes out. 1:success, 0:failure
+extern int sdn_stream(uint32_t sector, uint32_t len, void (*progress)(uint32_t done));
+
 // communication with the core
 extern void core_ctrl(uint32_t ctrl);   // 1: start loading, 0: end loading
 extern void core_data(uint32_t data);   // 3 word (12-byte) header, followed by 4-byte data words
@@ -71,6 +143,7 @@ extern void core_data(uint32_t data);   // 3 word (12-byte) header, followed by
                                         // header #2: ram_mask
 
 // SPI flash
+#define SPIDMA_FLASH (1 << 16)  // reg_spidma_ctrl: read from flash instead of SD
 extern void spiflash_read(uint32_t addr, uint8_t *buf, int length); // read from SPI flash
 extern void spiflash_write_enable();
 extern void spiflash_write_disable();                               
@@ -0,0 +1,253 @@
+// SD card access in native SD bus mode (4-bit) through sdhost.v.
+// This is about 8x faster than spi_sd.c at the same clock. diskio.c uses it when
+// built with SD_NATIVE and falls back to SPI mode if sdn_init() fails.
+//
+// Note that once a card has seen CMD0 in SPI mode, it only leaves SPI mode by
+// power cycling. So sdn_init() has to run before the first sd_init().
+
+#include "picorv32.h"
+
+// reg_sdhost_cmd bits
+#define SDN_RESP_R1         (1 << 6)    // also R6, R7
+#define SDN_RESP_R3         (2 << 6)    // no CRC
+#define SDN_RESP_R2         (3 << 6)    // 136-bit
+#define SDN_BUSY            (1 << 8)
+#define SDN_READ            (1 << 9)
+#define SDN_WRITE           (1 << 10)
+#define SDN_DATA_ONLY       (1 << 11)
+#define SDN_INIT_CLOCKS     (1 << 12)
+#define SDN_STREAM          (1 << 13)   // data goes to the core, see sdn_stream()
+
+// reg_sdhost_cmd status bits
+#define SDN_ST_BUSY         0x1
+#define SDN_ST_ERRORS       0x1e
+#define SDN_ST_PRESENT      0x80000000
+
+// reg_sdhost_ctrl bits
+#define SDN_CTRL_WIDE       (1 << 8)
+#define SDN_CTRL_EN         (1 << 9)
+#define SDN_CTRL_BLKLEN(n)  (((n) - 1) << 16)
+
+// SD clock is 21.5Mhz / (2*div). Identification runs at 400Khz or less.
+#define SDN_DIV_INIT        27
+#ifndef SD_NATIVE_DIV
+#define SD_NATIVE_DIV       1
+#endif
+
+#define SDN_TIMEOUT_MS      500
+
+static int sdn_sdhc;
+static uint32_t sdn_rca;
+static uint32_t sdn_ctrl;
+
+// issue a command and wait for it to finish
+// return 0: success, otherwise the error bits of the status register
+static uint32_t sdn_cmd(uint32_t cmd, uint32_t arg) {
+    uint32_t st;
+    uint32_t start = reg_time;
+    reg_sdhost_arg = arg;
+    reg_sdhost_cmd = cmd;
+    while ((st = reg_sdhost_cmd) & SDN_ST_BUSY) {
+        if (reg_time - start > SDN_TIMEOUT_MS) {
+            reg_sdhost_ctrl = sdn_ctrl;         // abort
+            DEBUG("sdn_cmd: timeout %x\n", cmd);
+            return SDN_ST_ERRORS;
+        }
+    }
+    return st & SDN_ST_ERRORS;
+}
+
+static uint32_t sdn_acmd(uint32_t cmd, uint32_t arg) {
+    uint32_t r = sdn_cmd(55 | SDN_RESP_R1, sdn_rca);
+    return r ? r : sdn_cmd(cmd, arg);
+}
+
+static void sdn_set_ctrl(uint32_t ctrl) {
+    sdn_ctrl = ctrl;
+    reg_sdhost_ctrl = ctrl;
+}
+
+// copy a block out of / into the host buffer
+static void sdn_readbuf(uint8_t *buf, int len) {
+    if (((uint32_t)buf & 3) == 0) {
+        for (int i = 0; i < len; i += 4)
+            *(uint32_t *)(buf + i) = reg_sdhost_data;
+    } else {
+        for (int i = 0; i < len; i += 4) {
+            uint32_t w = reg_sdhost_data;
+            buf[i] = w; buf[i+1] = w >> 8; buf[i+2] = w >> 16; buf[i+3] = w >> 24;
+        }
+    }
+}
+
+static void sdn_writebuf(const uint8_t *buf, int len) {
+    if (((uint32_t)buf & 3) == 0) {
+        for (int i = 0; i < len; i += 4)
+            reg_sdhost_data = *(const uint32_t *)(buf + i);
+    } else {
+        for (int i = 0; i < len; i += 4)
+            reg_sdhost_data = buf[i] | buf[i+1] << 8 | buf[i+2] << 16 | buf[i+3] << 24;
+    }
+}
+
+int sdn_init() {
+    if (!(reg_sdhost_cmd & SDN_ST_PRESENT)) {
+        DEBUG("sdn_init: no sdhost\n");
+        return -1;
+    }
+    sdn_set_ctrl(SDN_CTRL_EN | SDN_CTRL_BLKLEN(512) | SDN_DIV_INIT);
+    sdn_rca = 0;
+
+    sdn_cmd(SDN_INIT_CLOCKS, 0);
+    sdn_cmd(0, 0);                                  // CMD0 GO_IDLE_STATE, no response
+
+    // CMD8 SEND_IF_COND: 2.7-3.6V, check pattern. No response from v1 cards.
+    uint32_t hcs = 0;
+    if (sdn_cmd(8 | SDN_RESP_R1, 0x1AA) == 0 && (reg_sdhost_resp & 0xfff) == 0x1AA)
+        hcs = 0x40000000;
+
+    // ACMD41 SD_SEND_OP_COND until the card is no longer busy, up to 1 second
+    uint32_t start = reg_time, ocr = 0;
+    do {
+        if (sdn_acmd(41 | SDN_RESP_R3, 0x00ff8000 | hcs) == 0)
+            ocr = reg_sdhost_resp;
+        if (reg_time - start > 1000) {
+            DEBUG("sdn_init: ACMD41 failure\n");
+            goto fail;
+        }
+    } while (!(ocr & 0x80000000));
+    sdn_sdhc = (ocr >> 30) & 1;
+
+    if (sdn_cmd(2 | SDN_RESP_R2, 0)) {              // CMD2 ALL_SEND_CID
+        DEBUG("sdn_init: CMD2 failure\n");
+        goto fail;
+    }
+    if (sdn_cmd(3 | SDN_RESP_R1, 0)) {              // CMD3 SEND_RELATIVE_ADDR
+        DEBUG("sdn_init: CMD3 failure\n");
+        goto fail;
+    }
+    sdn_rca = reg_sdhost_resp & 0xffff0000;
+    if (sdn_cmd(7 | SDN_RESP_R1 | SDN_BUSY, sdn_rca)) { // CMD7 SELECT_CARD
+        DEBUG("sdn_init: CMD7 failure\n");
+        goto fail;
+    }
+    if (sdn_acmd(6 | SDN_RESP_R1, 2)) {             // ACMD6 SET_BUS_WIDTH 4-bit
+        DEBUG("sdn_init: ACMD6 failure\n");
+        goto fail;
+    }
+    sdn_set_ctrl(SDN_CTRL_EN | SDN_CTRL_WIDE | SDN_CTRL_BLKLEN(512) | SDN_DIV_INIT);
+
+    // CMD6 SWITCH_FUNC to high speed (group 1 function 1), needed above 25Mhz.
+    // The 64-byte status says whether it took effect.
+    int hs = 0;
+    sdn_set_ctrl(SDN_CTRL_EN | SDN_CTRL_WIDE | SDN_CTRL_BLKLEN(64) | SDN_DIV_INIT);
+    if (sdn_cmd(6 | SDN_RESP_R1 | SDN_READ, 0x80fffff1) == 0) {
+        uint32_t status[16];
+        sdn_readbuf((uint8_t *)status, 64);
+        hs = (status[4] & 0xf) == 1;                // byte 16, bits 379:376
+    }
+    sdn_set_ctrl(SDN_CTRL_EN | SDN_CTRL_WIDE | SDN_CTRL_BLKLEN(512) | SD_NATIVE_DIV);
+
+    DEBUG("SD native init complete. sdhc=%d, rca=%x, high speed=%d\n", sdn_sdhc, sdn_rca >> 16, hs);
+    return 0;
+
+fail:
+    sdn_set_ctrl(0);                                // give the pins back to SPI
+    return -2;
+}
+
+int sdn_readsector(uint32_t start_block, uint8_t *buffer, uint32_t sector_count) {
+    if (sector_count == 0)
+        return 0;
+    uint32_t addr = sdn_sdhc ? start_block : start_block * 512;
+    int multi = sector_count > 1;
+
+    // CMD17 READ_SINGLE_BLOCK or CMD18 READ_MULTIPLE_BLOCK brings in the first
+    // block, each DATA_ONLY read the next one
+    uint32_t r = sdn_cmd((multi ? 18 : 17) | SDN_RESP_R1 | SDN_READ, addr);
+    while (r == 0) {
+        sdn_readbuf(buffer, 512);
+        buffer += 512;
+        if (--sector_count == 0)
+            break;
+        r = sdn_cmd(SDN_DATA_ONLY | SDN_READ, 0);
+    }
+    if (multi)
+        sdn_cmd(12 | SDN_RESP_R1 | SDN_BUSY, 0);    // CMD12 STOP_TRANSMISSION
+    if (r)
+        DEBUG("sdn_readsector: error %x\n", r);
+    return r == 0;
+}
+
+int sdn_writesector(uint32_t start_block, const uint8_t *buffer, uint32_t sector_count) {
+    if (sector_count == 0)
+        return 0;
+    uint32_t addr = sdn_sdhc ? start_block : start_block * 512;
+    int multi = sector_count > 1;
+
+    // ACMD23 SET_WR_BLK_ERASE_COUNT lets the card pre-erase, optional
+    if (multi)
+        sdn_acmd(23 | SDN_RESP_R1, sector_count);
+
+    // CMD24 WRITE_BLOCK or CMD25 WRITE_MULTIPLE_BLOCK sends the first block,
+    // each DATA_ONLY write the next one
+    sdn_writebuf(buffer, 512);
+    uint32_t r = sdn_cmd((multi ? 25 : 24) | SDN_RESP_R1 | SDN_WRITE, addr);
+    while (r == 0 && --sector_count) {
+        buffer += 512;
+        sdn_writebuf(buffer, 512);
+        r = sdn_cmd(SDN_DATA_ONLY | SDN_WRITE, 0);
+    }
+    if (multi)
+        sdn_cmd(12 | SDN_RESP_R1 | SDN_BUSY, 0);    // CMD12 STOP_TRANSMISSION
+    if (r)
+        DEBUG("sdn_writesector: error %x\n", r);
+    return r == 0;
+}
+
+// CMD13 SEND_STATUS, a cheap check that the card is still there
+// return 0 if the card answers and is in transfer state
+int sdn_status() {
+    if (sdn_cmd(13 | SDN_RESP_R1, sdn_rca))
+        return -1;
+    return ((reg_sdhost_resp >> 9) & 0xf) == 4 ? 0 : -2;
+}
+
+int sdn_active() {
+    return (sdn_ctrl & SDN_CTRL_EN) != 0;
+}
+
+// Send len bytes starting at start_block to the core through the romload path,
+// with a single CMD18. The host keeps reading blocks on its own, so the CPU only
+// watches reg_sdhost_stream count down. ROM loading must be on (core_ctrl(1)).
+int sdn_stream(uint32_t start_block, uint32_t len, void (*progress)(uint32_t done)) {
+    if (len == 0)
+        return 1;
+    uint32_t addr = sdn_sdhc ? start_block : start_block * 512;
+    uint32_t left = len, st;
+
+    reg_sdhost_stream = len;
+    reg_sdhost_arg = addr;
+    reg_sdhost_cmd = 18 | SDN_RESP_R1 | SDN_READ | SDN_STREAM;
+    uint32_t start = reg_time;
+    while ((st = reg_sdhost_cmd) & SDN_ST_BUSY) {
+        uint32_t l = reg_sdhost_stream;
+        if (l != left) {
+            left = l;
+            start = reg_time;
+            if (progress)
+                progress(len - left);
+        } else if (reg_time - start > SDN_TIMEOUT_MS) {
+            reg_sdhost_ctrl = sdn_ctrl;         // abort
+            st = SDN_ST_ERRORS;
+            break;
+        }
+    }
+    sdn_cmd(12 | SDN_RESP_R1 | SDN_BUSY, 0);    // CMD12 STOP_TRANSMISSION
+    st &= SDN_ST_ERRORS;
+    if (st || reg_sdhost_stream) {
+        DEBUG("sdn_stream: error %x, %d bytes left\n", st, reg_sdhost_stream);
+        return 0;
+    }
+    return 1;
+}
@@ -38,6 +38,18 @@ uint8_t spi_sendrecv(uint8_t x) {
 
 void spi_readblock(uint8_t *ptr, int length) {
     int i = 0;
+#ifdef SPI_DMA
+    // the DMA writes whole words, up to 64KB at a time
+    if ((((uint32_t)ptr) & 3) == 0) {
+        while (i+4 <= length) {
+            int n = min(length - i, 0xfffc) & ~3;
+            reg_spidma_addr = (uint32_t)ptr;
+            reg_spidma_ctrl = n;            // returns when the block is in memory
+            ptr += n;
+            i += n;
+        }
+    }
+#endif
     if ((((uint32_t)ptr) & 3) == 0) {   // aligned on word boundaries
         // transfer in 4-byte words. this is about twice as fast
         for (; i+4<=length; i+=4) {
@@ -66,8 +78,13 @@ void spi_writeblock(const uint8_t *ptr, int length) {
 #define CMD0_GO_IDLE_STATE              0
 #define CMD1_SEND_OP_COND               1
 #define CMD8_SEND_IF_COND               8
+#define CMD12_STOP_TRANSMISSION         12
+#define CMD13_SEND_STATUS               13
 #define CMD17_READ_SINGLE_BLOCK         17
+#define CMD18_READ_MULTIPLE_BLOCK       18
+#define ACMD23_SET_WR_BLK_ERASE_COUNT   23
 #define CMD24_WRITE_SINGLE_BLOCK        24
+#define CMD25_WRITE_MULTIPLE_BLOCK      25
 #define CMD32_ERASE_WR_BLK_START        32
 #define CMD33_ERASE_WR_BLK_END          33
 #define CMD38_ERASE                     38
@@ -78,6 +95,7 @@ void spi_writeblock(const uint8_t *ptr, int length) {
 #define CMD_START_BITS                  0x40
 #define CMD0_CRC                        0x95
 #define CMD8_CRC                        0x87
+#define CMD12_CRC                       0x61
 
 #define OCR_SHDC_FLAG                   0x40
 #define CMD_OK                          0x01
@@ -87,10 +105,38 @@ void spi_writeblock(const uint8_t *ptr, int length) {
 #define ACMD41_HOST_SUPPORTS_SDHC       0x40000000
 
 #define CMD_START_OF_BLOCK              0xFE
+#define CMD_START_OF_MULTI_BLOCK        0xFC
+#define CMD_STOP_TRAN                   0xFD
 #define CMD_DATA_ACCEPTED               0x05
 
+// SPI clock is 21.5Mhz / (2*div). Card identification has to run at 400Khz or
+// less. After that the card accepts up to 25Mhz, but simplespimaster needs
+// div >= 2 for MOSI setup time, so 5.4Mhz (div 2) is the fastest.
+#define SD_SPI_DIV_INIT                 27
+#ifndef SD_SPI_DIV
+#define SD_SPI_DIV                      2
+#endif
+
+// busy after a write can last 250ms (SDHC) to 500ms (SDXC)
+#define SD_BUSY_TIMEOUT_MS              500
+
 static int sdhc_card = 0;
 
+#ifdef SD_CRC
+// CRC16-CCITT (polynomial 0x1021, initial value 0) of SD data blocks
+static uint16_t sd_crc16(const uint8_t *p, int len) {
+    uint16_t crc = 0;
+    while (len--) {
+        crc = (uint8_t)(crc >> 8) | (crc << 8);
+        crc ^= *p++;
+        crc ^= (uint8_t)(crc & 0xff) >> 4;
+        crc ^= crc << 12;
+        crc ^= (crc & 0xff) << 5;
+    }
+    return crc;
+}
+#endif
+
 uint8_t sd_send_command(uint8_t cmd, uint32_t arg) {
     uint8_t response = 0xFF;
     uint8_t status;
@@ -99,7 +145,9 @@ uint8_t sd_send_command(uint8_t cmd, uint32_t arg) {
     if(!sdhc_card) {
         switch (cmd) {
             case CMD17_READ_SINGLE_BLOCK:
+            case CMD18_READ_MULTIPLE_BLOCK:
             case CMD24_WRITE_SINGLE_BLOCK:
+            case CMD25_WRITE_MULTIPLE_BLOCK:
             case CMD32_ERASE_WR_BLK_START:
             case CMD33_ERASE_WR_BLK_END:
 		        arg *= 512;
@@ -159,6 +207,8 @@ int sd_init() {
     uint8_t response = 0xFF;
     uint8_t sd_version;
 
+    reg_spimaster_div = SD_SPI_DIV_INIT;
+
     // 74 or more clock pulses to SCLK
     for (int i = 0; i < 10; i++)
         spi_send(0xff);
@@ -221,10 +271,18 @@ int sd_init() {
        sdhc_card = 0;
     }
 
+    reg_spimaster_div = SD_SPI_DIV;
+
     DEBUG("SD init complete. sdhc_card=%d, sd_version=%d\n", sdhc_card, sd_version);
     return 0;
 }
 
+// CMD13 has a 2-byte R2 response. The second byte goes with the 8 clocks after
+// the command. return 0 if the card answers without errors
+int sd_status() {
+    return sd_send_command(CMD13_SEND_STATUS, 0) == 0 ? 0 : -1;
+}
+
 void debug_print_buf(uint8_t *buf, int len) {
 #ifdef SECTOR_PRINT_FULL
     for (int i = 0; i < len; i++) {
@@ -249,109 +307,186 @@ void debug_print_buf(uint8_t *buf, int len) {
     uart_print("\n");
 }
 
+// wait for the data start token, then read a 512-byte block and its CRC.
+// The CRC is only checked with SD_CRC.
+// return 1: success, 0: timeout or CRC error
+static int sd_readblock(uint8_t *buffer) {
+    int retries = 0;
+    while(spi_receive() != CMD_START_OF_BLOCK) {
+        // Timeout
+        if(retries > 5000) {
+            // DEBUG("sd_readsector: Timeout\n");
+            return 0;
+        }
+        ++retries;
+    }
+
+    // Perform block read (512 bytes)
+    spi_readblock(buffer, 512);
+
+#ifdef SD_CRC
+    uint16_t crc = spi_receive() << 8;
+    crc |= spi_receive();
+    if (crc != sd_crc16(buffer, 512)) {
+        LOG_WARN("sd_readblock: CRC error\n");
+        return 0;
+    }
+#else
+    // Ignore 16-bit CRC
+    spi_receive();
+    spi_receive();
+#endif
+    return 1;
+}
+
+// end a CMD18 multi-block read. The byte after CMD12 is a stuff byte and the R1b
+// response is followed by busy (0) until the card is ready again.
+static void sd_stop_transmission() {
+    spi_send(CMD12_STOP_TRANSMISSION | CMD_START_BITS);
+    spi_send(0);
+    spi_send(0);
+    spi_send(0);
+    spi_send(0);
+    spi_send(CMD12_CRC);
+    spi_receive();                      // stuff byte
+
+    int count = 0;
+    while(spi_receive() == 0xff && count++ < 500)
+        ;
+    count = 0;
+    while(spi_receive() == 0 && count++ < 5000)
+        ;
+    spi_send(0xFF);
+}
+
 int sd_readsector(uint32_t start_block, uint8_t *buffer, uint32_t sector_count) {
     uint8_t response;
-    int retries = 0;
 
     // DEBUG("sd_readsector: %d %d\n", start_block, sector_count);
     if (sector_count == 0)
         return 0;
-    while (sector_count--) {
+
+    if (sector_count == 1) {
         // Request block read
-        response = sd_send_command(CMD17_READ_SINGLE_BLOCK, start_block++);
+        response = sd_send_command(CMD17_READ_SINGLE_BLOCK, start_block);
         if(response != 0x00) {
             // DEBUG("sd_readsector: Bad response %x\n", response);
             return 0;
         }
+        if (!sd_readblock(buffer))
+            return 0;
 
-        // Wait for start of block indicator
-        while(spi_receive() != CMD_START_OF_BLOCK) {
-            // Timeout
-            if(retries > 5000) {
-                // DEBUG("sd_readsector: Timeout\n");
-                return 0;
-            }
-            ++retries;
-        }
-
-        // Perform block read (512 bytes)
-        spi_readblock(buffer, 512);
-
-        // DEBUG("sector: %d\n", start_block-1);
+        // DEBUG("sector: %d\n", start_block);
         // debug_print_buf(buffer, 512);
 
-        buffer += 512;
-
-        // Ignore 16-bit CRC
-        spi_receive();
-        spi_receive();
-
-        // DEBUG("sd_readsector: CRC over\n");
-
         // Additional 8 SPI clocks
         spi_sendrecv(0xFF);
-        // DEBUG("sd_readsector: additional 8 spi clocks over\n");
+        return 1;
+    }
+
+    // Contiguous sectors: one CMD18 streams all blocks, then CMD12 stops it
+    response = sd_send_command(CMD18_READ_MULTIPLE_BLOCK, start_block);
+    if(response != 0x00) {
+        // DEBUG("sd_readsector: Bad response %x\n", response);
+        return 0;
     }
+    while (sector_count--) {
+        if (!sd_readblock(buffer)) {
+            sd_stop_transmission();
+            return 0;
+        }
+        buffer += 512;
+    }
+    sd_stop_transmission();
     // DEBUG("sd_readsector: return\n");
     return 1;
 }
 
+// wait while the card signals busy (MISO held low) after a block is programmed
+// return 1: ready, 0: timeout
+static int sd_wait_ready() {
+    uint32_t start = reg_time;
+    while(spi_sendrecv(0xFF) == 0) {
+        // Timeout
+        if(reg_time - start > SD_BUSY_TIMEOUT_MS) {
+            DEBUG("sd_writesector: Timeout\n");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// send one data block with the given start token and check the data response
+// return 1: accepted and programmed, 0: failure
+static int sd_writeblock(uint8_t token, const uint8_t *buffer) {
+    // Indicate start of data transfer
+    spi_send(token);
+
+    // Send data block
+    spi_writeblock(buffer, 512);
+
+    // Send CRC (ignored)
+    spi_send(0xff);
+    spi_send(0xff);
+
+    // Get response
+    uint8_t response = spi_receive();
+    if((response & 0x1f) != CMD_DATA_ACCEPTED) {
+        DEBUG("sd_writesector: Data rejected %x\n", response);
+        return 0;
+    }
+
+    // Wait for data write complete
+    return sd_wait_ready();
+}
+
 int sd_writesector(uint32_t start_block, const uint8_t *buffer, uint32_t sector_count) {
     uint8_t response;
-    int retries = 0;
 
     DEBUG("sd_writesector: %d %d\n", start_block, sector_count);
-    while (sector_count--) {
+    if (sector_count == 0)
+        return 0;
+
+    if (sector_count == 1) {
         // Request block write
-        response = sd_send_command(CMD24_WRITE_SINGLE_BLOCK, start_block++);
+        response = sd_send_command(CMD24_WRITE_SINGLE_BLOCK, start_block);
         if(response != 0x00) {
             DEBUG("sd_writesector: Bad response %x\n", response);
             return 0;
         }
-
-        // Indicate start of data transfer
-        spi_send(CMD_START_OF_BLOCK);
-
-        // Send data block
-        spi_writeblock(buffer, 512);
-        buffer += 512;
-
-        // Send CRC (ignored)
-        spi_send(0xff);
-        spi_send(0xff);
-
-        // Get response
-        response = spi_receive(0xFF);
-
-        if((response & 0x1f) != CMD_DATA_ACCEPTED) {
-            DEBUG("sd_writesector: Data rejected %x\n", response);
+        if (!sd_writeblock(CMD_START_OF_BLOCK, buffer))
             return 0;
-        }
-
-        // Wait for data write complete
-        while(spi_sendrecv(0xFF) == 0) {
-            // Timeout
-	        if(retries > 5000) {
-                DEBUG("sd_writesector: Timeout\n");
-                return 0;
-            }
-	        ++retries;
-        }
 
         // Additional 8 SPI clocks
         spi_send(0xff);
+        return 1;
+    }
+
+    // Contiguous sectors: tell the card how many blocks follow so it can pre-erase
+    // them (ACMD23), then stream them all after one CMD25
+    sd_send_command(CMD55_APP_CMD, 0);
+    response = sd_send_command(ACMD23_SET_WR_BLK_ERASE_COUNT, sector_count);
+    if(response != 0x00)
+        DEBUG("sd_writesector: ACMD23 not supported %x\n", response);   // optional, continue
 
-	    retries = 0;
-	
-        // Wait for data write complete
-        while(spi_sendrecv(0xFF) == 0) {
-            // Timeout
-            if(retries > 5000) {
-                DEBUG("sd_writesector: Timeout\n");
-                return 0;
-            }
-            ++retries;
+    response = sd_send_command(CMD25_WRITE_MULTIPLE_BLOCK, start_block);
+    if(response != 0x00) {
+        DEBUG("sd_writesector: Bad response %x\n", response);
+        return 0;
+    }
+    int ok = 1;
+    while (sector_count--) {
+        if (!sd_writeblock(CMD_START_OF_MULTI_BLOCK, buffer)) {
+            ok = 0;
+            break;
         }
+        buffer += 512;
     }
-    return 1;
+
+    // Stop token, then one byte before the card starts signalling busy
+    spi_send(CMD_STOP_TRAN);
+    spi_send(0xff);
+    if (!sd_wait_ready())
+        return 0;
+    return ok;
 }
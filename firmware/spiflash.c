@@ -28,6 +28,18 @@ uint8_t flash_sendrecv(uint8_t x) {
 void flash_readblock(uint8_t *ptr, int length) {
     int i = 0;
     // uart_printf("flash_readblock: %d\n", length);
+#ifdef SPI_DMA
+    // the DMA writes whole words, up to 64KB at a time
+    if ((((uint32_t)ptr) & 3) == 0) {
+        while (i+4 <= length) {
+            int n = min(length - i, 0xfffc) & ~3;
+            reg_spidma_addr = (uint32_t)ptr;
+            reg_spidma_ctrl = SPIDMA_FLASH | n; // returns when the block is in memory
+            ptr += n;
+            i += n;
+        }
+    }
+#endif
     if ((((uint32_t)ptr) & 3) == 0) {   // aligned on word boundaries
         // transfer in 4-byte words. this is about twice as fast
         for (; i+4<=length; i+=4) {
@@ -42,8 +42,12 @@ DPB #(
     .ADB({addr_b, 2'b0, be_b[3:2]})
 );
 
+`else
+`ifdef SIM_NO_PUBLIC
+reg [31:0]    ram[0:1023];
 `else
 reg [31:0]    ram[0:1023] /* verilator public */;
+`endif
 
 always @(posedge clka) begin
     // Port A
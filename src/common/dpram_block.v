@@ -40,7 +40,11 @@ DPB #(
          addr_b)
 );
 `else
+`ifdef SIM_NO_PUBLIC
+reg [DATA_WIDTH-1:0]    ram[0:2**ADDR_WIDTH-1];
+`else
 reg [DATA_WIDTH-1:0]    ram[0:2**ADDR_WIDTH-1] /* verilator public */;
+`endif
 
 always @(posedge clka) begin
     // Port A
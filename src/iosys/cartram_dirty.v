@@ -0,0 +1,62 @@
+// Dirty bitmap of cartridge RAM (BSRAM), one bit per 512-byte page, so the
+// firmware writes back only the sectors of the save file that changed.
+// The core reports its cart RAM writes on cartram_we / cartram_addr.
+//
+// Registers:
+// 0x200_0080: Read: [0] 1 if any page is dirty, [31] 1: bitmap present.
+//             Write: clear the whole bitmap.
+//             With TRACK=0 (the core does not drive cartram_we), reads 1, so
+//             the firmware falls back to saving on any change.
+// 0x200_0084: Write: select bitmap word n (pages 32n to 32n+31).
+//             Read: the selected word. The bits read are cleared, except for
+//             pages written in the same cycle, so no write is lost.
+//
+// 128KB of cart RAM (256 pages) is covered, the largest SNES and GBA saves.
+module cartram_dirty #(
+    parameter TRACK = 0                 // 1: the core drives cartram_we/cartram_addr
+) (
+    input clk,
+    input resetn,
+
+    input             reg_dirty_we,
+    output     [31:0] reg_dirty_do,
+    input             reg_pages_we,
+    input             reg_pages_re,
+    input      [31:0] reg_di,
+    output     [31:0] reg_pages_do,
+
+    input             cartram_we,
+    input      [16:0] cartram_addr      // byte address in cart RAM
+);
+
+reg [31:0] pages [0:7];
+reg [2:0] sel;
+reg [7:0] any;                          // word n has dirty pages
+
+assign reg_dirty_do = TRACK ? {1'b1, 30'b0, |any} : 32'b1;
+assign reg_pages_do = pages[sel];
+
+wire [2:0] we_word = cartram_addr[16:14];
+wire [31:0] we_mask = 32'b1 << cartram_addr[13:9];
+
+integer i;
+always @(posedge clk) begin
+    if (~resetn || reg_dirty_we) begin
+        for (i = 0; i < 8; i = i + 1)
+            pages[i] <= 0;
+        any <= 0;
+    end else begin
+        for (i = 0; i < 8; i = i + 1) begin : update
+            reg [31:0] w;
+            w = reg_pages_re && sel == i ? 32'b0 : pages[i];
+            if (cartram_we && we_word == i)
+                w = w | we_mask;
+            pages[i] <= w;
+            any[i] <= w != 0;
+        end
+    end
+    if (reg_pages_we)
+        sel <= reg_di[2:0];
+end
+
+endmodule
@@ -35,7 +35,8 @@
 module iosys_picorv32 #(
     parameter FREQ=21_477_000,
     parameter [14:0] COLOR_LOGO=15'b00000_10101_00000,
-    parameter [15:0] CORE_ID=1      // 1: nestang, 2: snestang
+    parameter [15:0] CORE_ID=1,     // 1: nestang, 2: snestang
+    parameter CARTRAM_TRACK=0       // 1: the core drives cartram_we/cartram_addr
 )
 (
     input clk,                      // SNES mclk
@@ -67,6 +68,10 @@ module iosys_picorv32 #(
 
     input ram_busy,                 // iosys starts after SDRAM initialization
 
+    // cart RAM writes by the core, for the save dirty bitmap, see CARTRAM_TRACK
+    input cartram_we,
+    input [16:0] cartram_addr,      // byte address in BSRAM
+
     // SPI flash
     output flash_spi_cs_n,          // chip select
     input  flash_spi_miso,          // master in slave out
@@ -79,13 +84,13 @@ module iosys_picorv32 #(
     input uart_rx,
     output uart_tx,
 
-    // SD card
+    // SD card, SPI mode or native mode (sdhost)
     output sd_clk,
     inout  sd_cmd,                  // MOSI
-    input  sd_dat0,                 // MISO
-    output sd_dat1,                 // 1
-    output sd_dat2,                 // 1
-    output sd_dat3                  // 0 for SPI mode
+    inout  sd_dat0,                 // MISO
+    inout  sd_dat1,                 // 1
+    inout  sd_dat2,                 // 1
+    inout  sd_dat3                  // 0 for SPI mode
 );
 
 /* verilator lint_off PINMISSING */
@@ -168,9 +173,20 @@ wire        simpleuart_reg_dat_wait;
 
 wire        simplespimaster_reg_byte_sel /* synthesis syn_keep=1 */ = mem_valid && (mem_addr == 32'h0200_0020);
 wire        simplespimaster_reg_word_sel /* synthesis syn_keep=1 */ = mem_valid && (mem_addr == 32'h0200_0024);
+wire        simplespimaster_reg_div_sel = mem_valid && (mem_addr == 32'h0200_0028);
 wire [31:0] simplespimaster_reg_do;
+wire [31:0] simplespimaster_reg_div_do;
 wire        simplespimaster_reg_wait /* synthesis syn_keep=1 */;
 
+wire        sdhost_reg_cmd_sel = mem_valid && (mem_addr == 32'h0200_00A0);
+wire        sdhost_reg_arg_sel = mem_valid && (mem_addr == 32'h0200_00A4);
+wire        sdhost_reg_resp_sel = mem_valid && (mem_addr == 32'h0200_00A8);
+wire        sdhost_reg_data_sel = mem_valid && (mem_addr == 32'h0200_00AC);
+wire        sdhost_reg_ctrl_sel = mem_valid && (mem_addr == 32'h0200_00B0);
+wire        sdhost_reg_stream_sel = mem_valid && (mem_addr == 32'h0200_00B4);
+wire [31:0] sdhost_reg_status_do, sdhost_reg_arg_do, sdhost_reg_resp_do, sdhost_reg_data_do, sdhost_reg_ctrl_do;
+wire [31:0] sdhost_reg_stream_do;
+
 wire        romload_reg_ctrl_sel /* synthesis syn_keep=1 */ = mem_valid && (mem_addr == 32'h 0200_0030);       // write 1 to start loading, 0 to finish loading
 wire        romload_reg_data_sel /* synthesis syn_keep=1 */ = mem_valid && (mem_addr == 32'h 0200_0034);       // write once to load 4 bytes
 
@@ -185,22 +201,54 @@ wire        spiflash_reg_byte_sel = mem_valid && (mem_addr == 32'h0200_0070);
 wire        spiflash_reg_word_sel = mem_valid && (mem_addr == 32'h0200_0074);
 wire        spiflash_reg_ctrl_sel = mem_valid && (mem_addr == 32'h0200_0078);
 
-assign mem_ready = ram_ready || textdisp_reg_char_sel || simpleuart_reg_div_sel || 
+wire        cartram_reg_dirty_sel = mem_valid && (mem_addr == 32'h0200_0080);
+wire        cartram_reg_pages_sel = mem_valid && (mem_addr == 32'h0200_0084);
+wire [31:0] cartram_reg_dirty_do, cartram_reg_pages_do;
+
+wire        romcrc_reg_crc_sel = mem_valid && (mem_addr == 32'h0200_0088);
+wire        romcrc_reg_sum_sel = mem_valid && (mem_addr == 32'h0200_008C);
+wire [31:0] romcrc_reg_crc_do, romcrc_reg_sum_do;
+
+wire        spidma_reg_addr_sel = mem_valid && (mem_addr == 32'h0200_0090);
+wire        spidma_reg_ctrl_sel = mem_valid && (mem_addr == 32'h0200_0094);
+wire [31:0] spidma_reg_addr_do;
+wire        spidma_reg_wait;
+wire        dma_busy, dma_sd_word_we, dma_flash_word_we, dma_mem_valid;
+wire [22:0] dma_mem_addr;
+wire [31:0] dma_mem_wdata;
+
+assign mem_ready = ram_ready || textdisp_reg_char_sel || simpleuart_reg_div_sel || simplespimaster_reg_div_sel ||
             romload_reg_ctrl_sel || romload_reg_data_sel || joystick_reg_sel || time_reg_sel || cycle_reg_sel || id_reg_sel ||
             (simpleuart_reg_dat_sel && !simpleuart_reg_dat_wait) ||
             ((simplespimaster_reg_byte_sel || simplespimaster_reg_word_sel) && !simplespimaster_reg_wait) ||
             (spiflash_reg_byte_sel || spiflash_reg_word_sel) && !spiflash_reg_wait ||
-            spiflash_reg_ctrl_sel;
+            spiflash_reg_ctrl_sel || cartram_reg_dirty_sel || cartram_reg_pages_sel ||
+            romcrc_reg_crc_sel || romcrc_reg_sum_sel ||
+            spidma_reg_addr_sel || spidma_reg_ctrl_sel && !spidma_reg_wait ||
+            sdhost_reg_cmd_sel || sdhost_reg_arg_sel || sdhost_reg_resp_sel || sdhost_reg_data_sel || sdhost_reg_ctrl_sel ||
+            sdhost_reg_stream_sel;
 
 assign mem_rdata = ram_ready ? ram_rdata :
         joystick_reg_sel ? {4'b0, joy2, 4'b0, joy1} :
         simpleuart_reg_div_sel ? simpleuart_reg_div_do :
         simpleuart_reg_dat_sel ? simpleuart_reg_dat_do : 
+        simplespimaster_reg_div_sel ? simplespimaster_reg_div_do :
         time_reg_sel ? time_reg :
         cycle_reg_sel ? cycle_reg :
         id_reg_sel ? {16'b0, CORE_ID} :
         (simplespimaster_reg_byte_sel | simplespimaster_reg_word_sel) ? simplespimaster_reg_do : 
         (spiflash_reg_byte_sel | spiflash_reg_word_sel) ? spiflash_reg_do :
+        cartram_reg_dirty_sel ? cartram_reg_dirty_do :
+        cartram_reg_pages_sel ? cartram_reg_pages_do :
+        romcrc_reg_crc_sel ? romcrc_reg_crc_do :
+        romcrc_reg_sum_sel ? romcrc_reg_sum_do :
+        (spidma_reg_addr_sel | spidma_reg_ctrl_sel) ? spidma_reg_addr_do :
+        sdhost_reg_cmd_sel ? sdhost_reg_status_do :
+        sdhost_reg_arg_sel ? sdhost_reg_arg_do :
+        sdhost_reg_resp_sel ? sdhost_reg_resp_do :
+        sdhost_reg_data_sel ? sdhost_reg_data_do :
+        sdhost_reg_ctrl_sel ? sdhost_reg_ctrl_do :
+        sdhost_reg_stream_sel ? sdhost_reg_stream_do :
         32'h 0000_0000;
 
 picorv32 #(
@@ -263,19 +311,49 @@ simpleuart simpleuart (
 );
 
 // spi sd card @ 0x0200_0020
-assign sd_dat1 = 1;
-assign sd_dat2 = 1;
-assign sd_dat3 = 0;
+// The SD pins belong to sdhost (below) when it is enabled
+wire spi_sck, spi_mosi;
+wire sdhost_en, sdhost_clk, sdhost_cmd_o, sdhost_cmd_oe, sdhost_dat_oe;
+wire [3:0] sdhost_dat_o;
+wire [7:0] sdhost_stream_do;
+wire sdhost_stream_do_valid;
+assign sd_clk = sdhost_en ? sdhost_clk : spi_sck;
+assign sd_cmd = ~sdhost_en ? spi_mosi : sdhost_cmd_oe ? sdhost_cmd_o : 1'bz;
+assign sd_dat0 = sdhost_en && sdhost_dat_oe ? sdhost_dat_o[0] : 1'bz;
+assign sd_dat1 = ~sdhost_en ? 1'b1 : sdhost_dat_oe ? sdhost_dat_o[1] : 1'bz;
+assign sd_dat2 = ~sdhost_en ? 1'b1 : sdhost_dat_oe ? sdhost_dat_o[2] : 1'bz;
+assign sd_dat3 = ~sdhost_en ? 1'b0 : sdhost_dat_oe ? sdhost_dat_o[3] : 1'bz;
 simplespimaster simplespi (
     .clk(clk), .resetn(resetn),
-    .sck(sd_clk), .mosi(sd_cmd), .miso(sd_dat0),
+    .sck(spi_sck), .mosi(spi_mosi), .miso(sd_dat0),
     .reg_byte_we(simplespimaster_reg_byte_sel ? mem_wstrb[0] : 1'b0),
-    .reg_word_we(simplespimaster_reg_word_sel ? mem_wstrb[0] : 1'b0),
-    .reg_di(mem_wdata),
+    .reg_word_we(simplespimaster_reg_word_sel ? mem_wstrb[0] : dma_sd_word_we),
+    .reg_div_we(simplespimaster_reg_div_sel ? mem_wstrb[0] : 1'b0),
+    .reg_di(dma_busy ? 32'hffff_ffff : mem_wdata),
     .reg_do(simplespimaster_reg_do),
+    .reg_div_do(simplespimaster_reg_div_do),
     .reg_wait(simplespimaster_reg_wait)
 );
 
+// native mode sd card @ 0x0200_00A0
+sdhost sdhost (
+    .clk(clk), .resetn(resetn),
+    .sd_clk(sdhost_clk), .sd_cmd_i(sd_cmd), .sd_cmd_o(sdhost_cmd_o), .sd_cmd_oe(sdhost_cmd_oe),
+    .sd_dat_i({sd_dat3, sd_dat2, sd_dat1, sd_dat0}), .sd_dat_o(sdhost_dat_o), .sd_dat_oe(sdhost_dat_oe),
+    .enable(sdhost_en),
+    .reg_cmd_we(sdhost_reg_cmd_sel && mem_wstrb[0]),
+    .reg_arg_we(sdhost_reg_arg_sel && mem_wstrb[0]),
+    .reg_ctrl_we(sdhost_reg_ctrl_sel && mem_wstrb[0]),
+    .reg_data_we(sdhost_reg_data_sel && mem_wstrb[0]),
+    .reg_data_re(sdhost_reg_data_sel && !mem_wstrb),
+    .reg_di(mem_wdata),
+    .reg_status_do(sdhost_reg_status_do), .reg_arg_do(sdhost_reg_arg_do), .reg_resp_do(sdhost_reg_resp_do),
+    .reg_data_do(sdhost_reg_data_do), .reg_ctrl_do(sdhost_reg_ctrl_do),
+    .reg_stream_we(sdhost_reg_stream_sel && mem_wstrb[0]),
+    .reg_stream_do(sdhost_reg_stream_do),
+    .stream_do(sdhost_stream_do), .stream_do_valid(sdhost_stream_do_valid)
+);
+
 // ROM loading I/O @ 0x02000_0030
 reg [1:0] rom_cnt;
 reg [31:0] rom_do_buf;
@@ -293,6 +371,10 @@ always @(posedge clk) begin
         rom_cnt <= rom_cnt - 2'd1;
         rom_do_valid <= 1;
     end
+    if (sdhost_stream_do_valid) begin   // sdhost stream reads go straight to the core
+        rom_do_buf[7:0] <= sdhost_stream_do;
+        rom_do_valid <= 1;
+    end
 end
 always @(posedge clk) begin
     if (romload_reg_ctrl_sel && mem_wstrb) begin
@@ -304,6 +386,15 @@ always @(posedge clk) begin
     end    
 end
 
+// checksums of the ROM data @ 0x0200_0088
+romcrc romcrc (
+    .clk(clk), .resetn(resetn),
+    .reg_crc_we(romcrc_reg_crc_sel && mem_wstrb[0]), .reg_crc_do(romcrc_reg_crc_do),
+    .reg_sum_we(romcrc_reg_sum_sel && mem_wstrb[0]), .reg_sum_do(romcrc_reg_sum_do),
+    .reg_di(mem_wdata),
+    .rom_do(rom_do), .rom_do_valid(rom_do_valid)
+);
+
 // SPI flash @ 0x02000_0070
 // Load 256KB of ROM from flash address 0x500000 into SDRAM at address 0x0
 spiflash #(.ADDR(24'h500000), .LEN(FIRMWARE_SIZE)) flash (
@@ -314,18 +405,43 @@ spiflash #(.ADDR(24'h500000), .LEN(FIRMWARE_SIZE)) flash (
     .start(flash_start), .dout(flash_dout), .dout_strb(flash_out_strb), .busy(),
 
     .reg_byte_we(spiflash_reg_byte_sel ? mem_wstrb[0] : 1'b0),
-    .reg_word_we(spiflash_reg_word_sel ? mem_wstrb[0] : 1'b0),
+    .reg_word_we(spiflash_reg_word_sel ? mem_wstrb[0] : dma_flash_word_we),
     .reg_ctrl_we(spiflash_reg_ctrl_sel ? mem_wstrb[0] : 1'b0),
-    .reg_di(mem_wdata), .reg_do(spiflash_reg_do), .reg_wait(spiflash_reg_wait)
+    .reg_di(dma_busy ? 32'hffff_ffff : mem_wdata), .reg_do(spiflash_reg_do), .reg_wait(spiflash_reg_wait)
+);
+
+// SPI block reads into RAM @ 0x0200_0090
+// While busy, the CPU waits on the start register and the DMA has the RAM port
+spidma dma (
+    .clk(clk), .resetn(resetn),
+    .reg_addr_we(spidma_reg_addr_sel && mem_wstrb[0]),
+    .reg_ctrl_we(spidma_reg_ctrl_sel && mem_wstrb[0]),
+    .reg_di(mem_wdata), .reg_addr_do(spidma_reg_addr_do), .reg_wait(spidma_reg_wait),
+    .busy(dma_busy),
+    .sd_word_we(dma_sd_word_we), .flash_word_we(dma_flash_word_we),
+    .sd_do(simplespimaster_reg_do), .sd_wait(simplespimaster_reg_wait),
+    .flash_do(spiflash_reg_do), .flash_wait(spiflash_reg_wait),
+    .mem_valid(dma_mem_valid), .mem_addr(dma_mem_addr), .mem_wdata(dma_mem_wdata),
+    .mem_ready(rv_ready)
+);
+
+// save RAM dirty pages @ 0x0200_0080
+cartram_dirty #(.TRACK(CARTRAM_TRACK)) dirty (
+    .clk(clk), .resetn(resetn),
+    .reg_dirty_we(cartram_reg_dirty_sel && mem_wstrb[0]), .reg_dirty_do(cartram_reg_dirty_do),
+    .reg_pages_we(cartram_reg_pages_sel && mem_wstrb[0]),
+    .reg_pages_re(cartram_reg_pages_sel && mem_wstrb == 4'b0),
+    .reg_di(mem_wdata), .reg_pages_do(cartram_reg_pages_do),
+    .cartram_we(cartram_we), .cartram_addr(cartram_addr)
 );
 
 // RV memory access
-assign rv_addr = flash_loading ? flash_addr : mem_addr;
-assign rv_wdata = flash_loading ? {flash_d, flash_d, flash_d, flash_d} : mem_wdata;
-assign rv_wstrb = flash_loading ? flash_wstrb : mem_wstrb;
+assign rv_addr = flash_loading ? flash_addr : dma_busy ? dma_mem_addr : mem_addr;
+assign rv_wdata = flash_loading ? {flash_d, flash_d, flash_d, flash_d} : dma_busy ? dma_mem_wdata : mem_wdata;
+assign rv_wstrb = flash_loading ? flash_wstrb : dma_busy ? 4'b1111 : mem_wstrb;
 assign ram_rdata = rv_rdata;
-assign rv_valid = flash_loading ? flash_wr : (mem_valid & ram_sel);
-assign ram_ready = rv_ready;
+assign rv_valid = flash_loading ? flash_wr : dma_busy ? dma_mem_valid : (mem_valid & ram_sel);
+assign ram_ready = rv_ready & ~dma_busy;
 
 // Time counter register
 reg [31:0] time_reg, cycle_reg;
@@ -0,0 +1,62 @@
+// Checksums of the ROM data going to the core, one byte per cycle, for both
+// core_data() writes and sdhost stream reads. So the firmware can verify a ROM
+// without another pass over the data.
+//
+// Registers:
+// 0x200_0088: Read: CRC-32 (IEEE 802.3) of the bytes since the last reset.
+//             Write: reset the CRC, the sum and the byte count.
+// 0x200_008C: Read: [15:0] sum of the big-endian 16-bit words after the first
+//             `skip` bytes (the MD header checksum, with skip = 0x200).
+//             Write: set skip in bytes.
+module romcrc (
+    input clk,
+    input resetn,
+
+    input             reg_crc_we,
+    output     [31:0] reg_crc_do,
+    input             reg_sum_we,
+    output     [31:0] reg_sum_do,
+    input      [31:0] reg_di,
+
+    input       [7:0] rom_do,
+    input             rom_do_valid
+);
+
+reg [31:0] crc;
+reg [15:0] sum;
+reg [31:0] cnt;
+reg [31:0] skip;
+reg [7:0] hi;                           // first byte of the current word
+
+assign reg_crc_do = ~crc;
+assign reg_sum_do = {16'b0, sum};
+
+function [31:0] crc32_byte(input [31:0] c, input [7:0] d);
+    integer i;
+    begin
+        crc32_byte = c ^ d;
+        for (i = 0; i < 8; i = i + 1)
+            crc32_byte = {1'b0, crc32_byte[31:1]} ^ (crc32_byte[0] ? 32'hEDB88320 : 32'h0);
+    end
+endfunction
+
+always @(posedge clk) begin
+    if (~resetn || reg_crc_we) begin
+        crc <= 32'hFFFF_FFFF;
+        sum <= 0;
+        cnt <= 0;
+    end else if (rom_do_valid) begin
+        crc <= crc32_byte(crc, rom_do);
+        cnt <= cnt + 1;
+        if (~cnt[0])
+            hi <= rom_do;
+        else if (cnt >= skip)
+            sum <= sum + {hi, rom_do};
+    end
+    if (~resetn)
+        skip <= 0;
+    else if (reg_sum_we)
+        skip <= reg_di;
+end
+
+endmodule
@@ -0,0 +1,436 @@
+// SD card host for picorv32 in native SD bus mode, 1-bit or 4-bit wide.
+// This is the fast alternative to simplespimaster. Both share the SD pins, which
+// belong to this module when CTRL enable is set.
+//
+// Registers:
+// 0x200_00A0: CMD. Write to start a command:
+//             [5:0]  command index
+//             [7:6]  response: 0 none, 1 48-bit, 2 48-bit without CRC (R3), 3 136-bit (R2)
+//             [8]    wait while the card is busy (DAT0 low) after the response (R1b)
+//             [9]    read a data block after the command
+//             [10]   write the data block in the buffer after the response
+//             [11]   no command, only transfer the next data block (multi-block)
+//             [12]   no command, only send 80 clocks with CMD high (power-up)
+//             [13]   stream: with [9], keep reading blocks until STREAM bytes have
+//                    been sent to stream_do instead of the CPU (ROM loading)
+//             Read returns status:
+//             [0]    busy
+//             [1]    response timeout
+//             [2]    response CRC error
+//             [3]    data CRC error, or written block not accepted by the card
+//             [4]    data timeout
+//             [31]   1: host present
+// 0x200_00A4: ARG. Command argument.
+// 0x200_00A8: RESP. Bits [39:8] of the last response (card status, OCR or RCA).
+// 0x200_00AC: DATA. Block buffer. Each read or write accesses the next word, first
+//             byte in [7:0]. The read pointer resets when a command starts, the
+//             write pointer when a command ends.
+// 0x200_00B0: CTRL. [7:0] clock divider, SD clock is clk / (2*div).
+//             [8] 4-bit bus. [9] enable, drive the SD pins.
+//             [24:16] block length - 1, in bytes. Must be a multiple of 4, max 512.
+//             Writing CTRL aborts the active command.
+// 0x200_00B4: STREAM. Number of bytes for the next stream read. Read returns the
+//             bytes still to go. A stream read ends after the block holding the
+//             last byte, the CPU then stops the card with CMD12.
+//
+// Outputs change on the falling edge of sd_clk and inputs are sampled at the
+// rising edge, which works for both default and high speed card timing. The
+// clock only runs during a command, so the card waits between blocks of a
+// multi-block transfer until the CPU has emptied or filled the buffer. Stream
+// reads do not wait, a whole run of sectors goes out at the SD bus rate.
+module sdhost (
+    input clk,
+    input resetn,
+
+    output reg sd_clk,
+    input  sd_cmd_i,
+    output reg sd_cmd_o,
+    output reg sd_cmd_oe,
+    input  [3:0] sd_dat_i,
+    output reg [3:0] sd_dat_o,
+    output reg sd_dat_oe,
+    output enable,                  // 1: SD pins are driven by sdhost
+
+    input             reg_cmd_we,
+    input             reg_arg_we,
+    input             reg_ctrl_we,
+    input             reg_data_we,
+    input             reg_data_re,
+    input      [31:0] reg_di,
+    output     [31:0] reg_status_do,
+    output     [31:0] reg_arg_do,
+    output     [31:0] reg_resp_do,
+    output     [31:0] reg_data_do,
+    output     [31:0] reg_ctrl_do,
+    input             reg_stream_we,
+    output     [31:0] reg_stream_do,
+
+    output reg  [7:0] stream_do,    // data of stream reads, in card order
+    output reg        stream_do_valid
+);
+
+localparam C_IDLE = 0, C_INIT = 1, C_TX = 2, C_RESP_WAIT = 3, C_RESP = 4,
+           C_RESP_DONE = 5, C_BUSY = 6, C_TAIL = 7;
+localparam D_IDLE = 0, D_RX_WAIT = 1, D_RX = 2, D_RX_CRC = 3, D_RX_END = 4,
+           D_TX_NWR = 5, D_TX = 6, D_TX_CRC = 7, D_TX_END = 8, D_TX_STATUS_WAIT = 9,
+           D_TX_STATUS = 10, D_BUSY = 11;
+
+// CRC7 of the first 40 bits of a command or response: x^7 + x^3 + 1
+function [6:0] crc7(input [39:0] d);
+    integer i;
+    reg fb;
+    begin
+        crc7 = 0;
+        for (i = 39; i >= 0; i = i - 1) begin
+            fb = d[i] ^ crc7[6];
+            crc7 = {crc7[5:0], 1'b0} ^ (fb ? 7'h09 : 7'h00);
+        end
+    end
+endfunction
+
+// CRC16 of one data line, one bit at a time: x^16 + x^12 + x^5 + 1
+function [15:0] crc16(input [15:0] crc, input d);
+    crc16 = {crc[14:0], 1'b0} ^ (d ^ crc[15] ? 16'h1021 : 16'h0000);
+endfunction
+
+reg [7:0] div = 8'd128;
+reg       wide;
+reg       en;
+reg [8:0] blklen = 9'd511;
+reg [31:0] arg;
+reg [13:0] cmd;
+reg [31:0] stream_cnt;
+reg err_timeout, err_crc, err_dcrc, err_dtimeout;
+
+reg [2:0] cmd_state;
+reg [3:0] dat_state;
+wire busy = cmd_state != C_IDLE || dat_state != D_IDLE;
+reg busy_r;
+wire run = busy;
+
+assign enable = en;
+assign reg_status_do = {1'b1, 26'b0, err_dtimeout, err_dcrc, err_crc, err_timeout, busy};
+assign reg_arg_do = arg;
+assign reg_ctrl_do = {7'b0, blklen, 6'b0, en, wide, div};
+assign reg_stream_do = stream_cnt;
+
+// SD clock
+reg [7:0] clk_cnt;
+wire tick = clk_cnt >= div - 8'd1;
+wire rise = tick & ~sd_clk & run;
+wire fall = tick & sd_clk;
+always @(posedge clk) begin
+    clk_cnt <= tick ? 8'd0 : clk_cnt + 8'd1;
+    if (rise) sd_clk <= 1;
+    else if (fall) sd_clk <= 0;
+    if (~resetn) sd_clk <= 0;
+end
+
+// block buffer, 128 words
+reg [31:0] buffer [0:127];
+reg [31:0] buf_q;
+reg [6:0] cpu_rptr, cpu_wptr;   // CPU word pointers
+reg [6:0] sd_ptr;               // SD side word pointer
+reg [31:0] rx_word;
+reg rx_wr;
+assign reg_data_do = buf_q;
+
+always @(posedge clk) begin
+    if (rx_wr)
+        buffer[sd_ptr] <= rx_word;
+    else if (reg_data_we && ~busy)
+        buffer[cpu_wptr] <= reg_di;
+    buf_q <= buffer[busy ? sd_ptr : cpu_rptr];
+end
+
+// command and response
+reg [47:0] cmd_sr;
+reg [47:0] resp_sr;
+reg [7:0] ccnt;
+assign reg_resp_do = resp_sr[39:8];
+
+// data
+reg [9:0] bytecnt;
+reg [2:0] bitcnt;
+reg [7:0] rx_byte;
+reg [31:0] tx_word;
+reg [63:0] dcrc;                // CRC16 of each DAT line
+reg [63:0] dcrc_rx;             // received CRC16 of each DAT line
+reg [19:0] dcnt;
+reg [2:0] wr_status;
+wire [7:0] rx_next = wide ? {rx_byte[3:0], sd_dat_i} : {rx_byte[6:0], sd_dat_i[0]};
+wire byte_done = wide ? bitcnt == 3'd1 : bitcnt == 3'd7;
+wire [3:0] tx_bits = wide ? (bitcnt[0] ? tx_word[3:0] : tx_word[7:4]) : {3'b111, tx_word[3'd7 - bitcnt]};
+wire dat_start = wide ? sd_dat_i == 4'b0 : ~sd_dat_i[0];
+
+integer i;
+
+always @(posedge clk) begin
+    rx_wr <= 0;
+    stream_do_valid <= 0;
+    if (~resetn) begin
+        cmd_state <= C_IDLE;
+        dat_state <= D_IDLE;
+        sd_cmd_oe <= 0;
+        sd_dat_oe <= 0;
+        en <= 0;
+        wide <= 0;
+        div <= 8'd128;
+        blklen <= 9'd511;
+        cpu_rptr <= 0;
+        cpu_wptr <= 0;
+        stream_cnt <= 0;
+        {err_timeout, err_crc, err_dcrc, err_dtimeout} <= 0;
+    end else begin
+        if (reg_arg_we) arg <= reg_di;
+        if (reg_stream_we && ~busy) stream_cnt <= reg_di;
+        if (reg_ctrl_we) begin
+            div <= reg_di[7:0] == 0 ? 8'd1 : reg_di[7:0];
+            wide <= reg_di[8];
+            en <= reg_di[9];
+            blklen <= reg_di[24:16];
+            cmd_state <= C_IDLE;
+            dat_state <= D_IDLE;
+            sd_cmd_oe <= 0;
+            sd_dat_oe <= 0;
+        end
+        if (~busy && reg_data_we)
+            cpu_wptr <= cpu_wptr + 7'd1;
+        if (~busy && reg_data_re)
+            cpu_rptr <= cpu_rptr + 7'd1;
+        busy_r <= busy;
+        if (busy_r && ~busy)
+            cpu_wptr <= 0;
+
+        // start a command
+        if (reg_cmd_we && ~busy) begin
+            cmd <= reg_di[13:0];
+            {err_timeout, err_crc, err_dcrc, err_dtimeout} <= 0;
+            cpu_rptr <= 0;
+            sd_ptr <= 0;
+            ccnt <= 0;
+            if (reg_di[12]) begin
+                cmd_state <= C_INIT;
+                sd_cmd_oe <= 1;
+                sd_cmd_o <= 1;
+            end else if (reg_di[11]) begin
+                dat_state <= reg_di[10] ? D_TX_NWR : D_RX_WAIT;
+                dcnt <= 0;
+            end else begin
+                cmd_sr <= {2'b01, reg_di[5:0], arg, crc7({2'b01, reg_di[5:0], arg}), 1'b1};
+                cmd_state <= C_TX;
+                sd_cmd_oe <= 1;
+                sd_cmd_o <= 0;      // start bit
+            end
+        end
+
+        case (cmd_state)
+        C_INIT: if (rise) begin
+            ccnt <= ccnt + 8'd1;
+            if (ccnt == 8'd79) begin
+                sd_cmd_oe <= 0;
+                cmd_state <= C_IDLE;
+            end
+        end
+        C_TX: if (fall) begin
+            ccnt <= ccnt + 8'd1;
+            if (ccnt == 8'd47) begin
+                sd_cmd_oe <= 0;
+                ccnt <= 0;
+                cmd_state <= cmd[7:6] == 2'd0 ? C_TAIL : C_RESP_WAIT;
+                if (cmd[9]) begin
+                    dat_state <= D_RX_WAIT;
+                    dcnt <= 0;
+                end
+            end else begin
+                sd_cmd_o <= cmd_sr[46];
+                cmd_sr <= {cmd_sr[46:0], 1'b1};
+            end
+        end
+        C_RESP_WAIT: if (rise) begin
+            ccnt <= ccnt + 8'd1;
+            if (~sd_cmd_i) begin
+                resp_sr <= 0;
+                ccnt <= 8'd1;
+                cmd_state <= C_RESP;
+            end else if (ccnt == 8'd64) begin
+                err_timeout <= 1;
+                ccnt <= 0;
+                cmd_state <= C_TAIL;
+                dat_state <= D_IDLE;
+            end
+        end
+        C_RESP: if (rise) begin
+            resp_sr <= {resp_sr[46:0], sd_cmd_i};
+            ccnt <= ccnt + 8'd1;
+            if (ccnt == (cmd[7:6] == 2'd3 ? 8'd135 : 8'd47))
+                cmd_state <= C_RESP_DONE;
+        end
+        C_RESP_DONE: begin
+            ccnt <= 0;
+            if (cmd[7:6] == 2'd1 && crc7(resp_sr[47:8]) != resp_sr[7:1]) begin
+                err_crc <= 1;
+                cmd_state <= C_TAIL;
+                dat_state <= D_IDLE;
+            end else begin
+                cmd_state <= cmd[8] ? C_BUSY : C_TAIL;
+                if (cmd[10]) begin
+                    dat_state <= D_TX_NWR;
+                    dcnt <= 0;
+                end
+            end
+        end
+        C_BUSY: if (rise) begin         // busy starts up to 2 clocks after the response
+            if (ccnt < 8'd2)
+                ccnt <= ccnt + 8'd1;
+            else if (sd_dat_i[0]) begin
+                ccnt <= 0;
+                cmd_state <= C_TAIL;
+            end
+        end
+        C_TAIL: if (rise) begin         // 8 clocks before the next command
+            ccnt <= ccnt + 8'd1;
+            if (ccnt == 8'd7)
+                cmd_state <= C_IDLE;
+        end
+        default: ;
+        endcase
+
+        case (dat_state)
+        D_RX_WAIT: if (rise) begin
+            dcnt <= dcnt + 20'd1;
+            if (dat_start) begin
+                bytecnt <= 0;
+                bitcnt <= 0;
+                dcrc <= 0;
+                dat_state <= D_RX;
+            end else if (&dcnt) begin
+                err_dtimeout <= 1;
+                dat_state <= D_IDLE;
+            end
+        end
+        D_RX: if (rise) begin
+            rx_byte <= rx_next;
+            bitcnt <= byte_done ? 3'd0 : bitcnt + 3'd1;
+            for (i = 0; i < 4; i = i + 1)
+                if (wide || i == 0)
+                    dcrc[i*16 +: 16] <= crc16(dcrc[i*16 +: 16], sd_dat_i[i]);
+            if (byte_done) begin
+                rx_word <= {rx_next, rx_word[31:8]};
+                bytecnt <= bytecnt + 10'd1;
+                if (cmd[13] && stream_cnt != 0) begin
+                    stream_do <= rx_next;
+                    stream_do_valid <= 1;
+                    stream_cnt <= stream_cnt - 32'd1;
+                end
+                if (bytecnt[1:0] == 2'd3) begin
+                    rx_wr <= 1;
+                    sd_ptr <= bytecnt[8:2];
+                end
+                if (bytecnt[8:0] == blklen) begin
+                    dcnt <= 0;
+                    dat_state <= D_RX_CRC;
+                end
+            end
+        end
+        D_RX_CRC: if (rise) begin
+            for (i = 0; i < 4; i = i + 1)
+                dcrc_rx[i*16 +: 16] <= {dcrc_rx[i*16 +: 15], sd_dat_i[i]};
+            dcnt <= dcnt + 20'd1;
+            if (dcnt == 20'd15)
+                dat_state <= D_RX_END;
+        end
+        D_RX_END: if (rise) begin       // end bit
+            sd_ptr <= 0;
+            dcnt <= 0;
+            if (wide ? dcrc != dcrc_rx : dcrc[15:0] != dcrc_rx[15:0]) begin
+                err_dcrc <= 1;
+                dat_state <= D_IDLE;
+            end else
+                dat_state <= cmd[13] && stream_cnt != 0 ? D_RX_WAIT : D_IDLE;
+        end
+        D_TX_NWR: if (fall) begin       // 2 clocks with DAT high, then the start bit
+            sd_ptr <= 0;
+            sd_dat_oe <= 1;
+            dcnt <= dcnt + 20'd1;
+            if (dcnt == 20'd2) begin
+                sd_dat_o <= wide ? 4'b0000 : 4'b1110;
+                tx_word <= buf_q;
+                sd_ptr <= 7'd1;
+                bytecnt <= 0;
+                bitcnt <= 0;
+                dcrc <= 0;
+                dat_state <= D_TX;
+            end else
+                sd_dat_o <= 4'b1111;
+        end
+        D_TX: if (fall) begin
+            sd_dat_o <= tx_bits;
+            for (i = 0; i < 4; i = i + 1)
+                dcrc[i*16 +: 16] <= crc16(dcrc[i*16 +: 16], tx_bits[i]);
+            bitcnt <= byte_done ? 3'd0 : bitcnt + 3'd1;
+            if (byte_done) begin
+                bytecnt <= bytecnt + 10'd1;
+                if (bytecnt[1:0] == 2'd3) begin
+                    tx_word <= buf_q;
+                    sd_ptr <= sd_ptr + 7'd1;
+                end else
+                    tx_word <= tx_word >> 8;
+                if (bytecnt[8:0] == blklen) begin
+                    dcnt <= 0;
+                    dat_state <= D_TX_CRC;
+                end
+            end
+        end
+        D_TX_CRC: if (fall) begin
+            for (i = 0; i < 4; i = i + 1)
+                sd_dat_o[i] <= dcrc[i*16 + 15] | ~wide & (i != 0);
+            dcrc <= {dcrc[62:0], 1'b0} & 64'hfffe_fffe_fffe_fffe;
+            dcnt <= dcnt + 20'd1;
+            if (dcnt == 20'd15)
+                dat_state <= D_TX_END;
+        end
+        D_TX_END: if (fall) begin
+            dcnt <= dcnt + 20'd1;
+            if (dcnt == 20'd16)
+                sd_dat_o <= 4'b1111;    // end bit
+            else begin
+                sd_dat_oe <= 0;
+                dcnt <= 0;
+                dat_state <= D_TX_STATUS_WAIT;
+            end
+        end
+        D_TX_STATUS_WAIT: if (rise) begin
+            dcnt <= dcnt + 20'd1;
+            if (~sd_dat_i[0]) begin
+                dcnt <= 0;
+                dat_state <= D_TX_STATUS;
+            end else if (dcnt == 20'd16) begin
+                err_dtimeout <= 1;
+                dat_state <= D_IDLE;
+            end
+        end
+        D_TX_STATUS: if (rise) begin    // 3 status bits and the end bit
+            wr_status <= {wr_status[1:0], sd_dat_i[0]};
+            dcnt <= dcnt + 20'd1;
+            if (dcnt == 20'd3) begin
+                if (wr_status != 3'b010)
+                    err_dcrc <= 1;
+                dcnt <= 0;
+                dat_state <= D_BUSY;
+            end
+        end
+        D_BUSY: if (rise) begin
+            if (dcnt < 20'd2)
+                dcnt <= dcnt + 20'd1;
+            else if (sd_dat_i[0]) begin
+                sd_ptr <= 0;
+                dat_state <= D_IDLE;
+            end
+        end
+        default: ;
+        endcase
+    end
+end
+
+endmodule
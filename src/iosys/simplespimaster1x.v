@@ -6,9 +6,15 @@
 //             The lowest byte is transfered over SPI.
 //             Then a read will return the received byte.
 // 0x200_0024: Word transfer. Writes and reads 4 bytes.
+// 0x200_0028: Clock divider. SPI clock is clk / (2*div), div >= 2, smaller
+//             values are raised to 2 (SPI_Master needs 2 clocks per half bit
+//             for MOSI setup time). Default is DIV (1/4 of clk). Only change it
+//             between transfers.
 //
-// SPI clock is 1/4 of clk. SD_DAT[3:1]=3'b011 for SPI mode.
-module simplespimaster (
+// SD_DAT[3:1]=3'b011 for SPI mode.
+module simplespimaster #(
+    parameter [7:0] DIV = 2
+) (
 	input clk,
     input spi_clk,
 	input resetn,
@@ -20,10 +26,12 @@ module simplespimaster (
 	// output cs,			// SD_DAT[3]
 
     input             reg_byte_we /* xsynthesis syn_keep=1*/,  // 1: write-read a byte 
+    input             reg_div_we,   // 1: write clock divider
     input	      	  reg_word_we /* xsynthesis syn_keep=1*/,	// 1: write-read a word
 
     input      [31:0] reg_di,
     output reg [31:0] reg_do,
+    output     [31:0] reg_div_do,
     output            reg_wait /* xsynthesis syn_keep=1*/
 );
 
@@ -37,11 +45,20 @@ reg wait_buf = 1;
 reg [1:0] cnt;  // how many bytes are already sent
 reg reg_byte_we_r, reg_word_we_r;
 reg active, new_request;
+reg [7:0] div = DIV;
+
+assign reg_div_do = {24'b0, div};
+always @(posedge clk) begin
+    if (~resetn)
+        div <= DIV;
+    else if (reg_div_we)
+        div <= reg_di[7:0] < 2 ? 8'd2 : reg_di[7:0];
+end
+
 wire spi_ready;
 
-SPI_Master #(.CLKS_PER_HALF_BIT(2)) spi_io_master (
-// SPI_Master #(.CLKS_PER_HALF_BIT(4)) spi_io_master (
-  .i_Clk(clk), .i_Rst_L(resetn),
+SPI_Master spi_io_master (
+  .i_Clk(clk), .i_Rst_L(resetn), .i_Clks_Per_Half_Bit(div),
   .i_TX_Byte(tx_byte), .i_TX_DV(spi_start), .o_TX_Ready(spi_ready),
   .o_RX_DV(), .o_RX_Byte(rx_byte),
   .o_SPI_Clk(sck), .i_SPI_MISO(miso), .o_SPI_MOSI(mosi)
@@ -47,7 +47,8 @@ module simpleuart #(parameter integer DEFAULT_DIV = 1) (
 	reg [15:0] send_divcnt;
 	reg send_dummy;
 
-	assign reg_div_do = cfg_divider;
+	// bit 31: transmitter busy, so firmware can send without stalling on reg_dat_wait
+	assign reg_div_do = {send_bitcnt != 0 || send_dummy, 15'b0, cfg_divider};
 
 	assign reg_dat_wait = reg_dat_we && (send_bitcnt != 0 || send_dummy);
 	assign reg_dat_do = recv_buf_valid ? {24'b0, recv_buf_data} : ~0;
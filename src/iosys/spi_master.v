@@ -23,20 +23,23 @@
 //               2   |             1             |        0
 //               3   |             1             |        1
 //              More: https://en.wikipedia.org/wiki/Serial_Peripheral_Interface_Bus#Mode_numbers
-//              CLKS_PER_HALF_BIT - Sets frequency of o_SPI_Clk.  o_SPI_Clk is
+//
+// Inputs:      i_Clks_Per_Half_Bit - Sets frequency of o_SPI_Clk.  o_SPI_Clk is
 //              derived from i_Clk.  Set to integer number of clocks for each
-//              half-bit of SPI data.  E.g. 100 MHz i_Clk, CLKS_PER_HALF_BIT = 2
-//              would create o_SPI_CLK of 25 MHz.  Must be >= 2
+//              half-bit of SPI data.  E.g. 100 MHz i_Clk, i_Clks_Per_Half_Bit = 2
+//              would create o_SPI_CLK of 25 MHz.  Must be >= 2, and should only
+//              change while o_TX_Ready is high.  Tie to a constant for a fixed
+//              clock.
 //
 ///////////////////////////////////////////////////////////////////////////////
 
 module SPI_Master
-  #(parameter SPI_MODE = 0,
-    parameter CLKS_PER_HALF_BIT = 2)
+  #(parameter SPI_MODE = 0)
   (
    // Control/Data Signals,
    input        i_Rst_L,     // FPGA Reset
    input        i_Clk,       // FPGA Clock
+   input [7:0]  i_Clks_Per_Half_Bit,  // SPI clock is i_Clk / (2*i_Clks_Per_Half_Bit)
    
    // TX (MOSI) Signals
    input [7:0]  i_TX_Byte,        // Byte to transmit on MOSI
@@ -57,7 +60,7 @@ module SPI_Master
   wire w_CPOL;     // Clock polarity
   wire w_CPHA;     // Clock phase
 
-  reg [$clog2(CLKS_PER_HALF_BIT*2)-1:0] r_SPI_Clk_Count;
+  reg [8:0] r_SPI_Clk_Count;
   reg r_SPI_Clk;
   reg [4:0] r_SPI_Clk_Edges;
   reg r_Leading_Edge;
@@ -110,14 +113,14 @@ module SPI_Master
       begin
         o_TX_Ready <= 1'b0;
         
-        if (r_SPI_Clk_Count == CLKS_PER_HALF_BIT*2-1)
+        if (r_SPI_Clk_Count == {i_Clks_Per_Half_Bit, 1'b0} - 9'd1)
         begin
           r_SPI_Clk_Edges <= r_SPI_Clk_Edges - 1'b1;
           r_Trailing_Edge <= 1'b1;
           r_SPI_Clk_Count <= 0;
           r_SPI_Clk       <= ~r_SPI_Clk;
         end
-        else if (r_SPI_Clk_Count == CLKS_PER_HALF_BIT-1)
+        else if (r_SPI_Clk_Count == i_Clks_Per_Half_Bit - 8'd1)
         begin
           r_SPI_Clk_Edges <= r_SPI_Clk_Edges - 1'b1;
           r_Leading_Edge  <= 1'b1;
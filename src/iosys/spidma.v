@@ -0,0 +1,123 @@
+// Block reads from the SPI masters (SD card or flash) straight into RV memory.
+// Instead of one word register access per 4 bytes, the CPU writes the RAM
+// address and then the length, and the write finishes when the whole block is
+// in memory.
+//
+// Registers:
+// 0x200_0090: RAM address of the next block, word aligned.
+// 0x200_0094: Start. [15:0] length in bytes, a multiple of 4.
+//             [16] 0: SD card (simplespimaster), 1: SPI flash.
+//             The write waits until the block is in RAM (reg_wait), like a
+//             word transfer of the SPI masters waits for its 4 bytes.
+//             Read returns the address after the last block.
+//
+// The DMA runs word transfers with 0xFF output on the selected SPI master,
+// through the same interface the CPU uses. Received words go through a 4-word
+// FIFO to the RV memory port, which the DMA owns while it is busy. So SPI bytes
+// keep flowing while SDRAM is busy with other ports.
+module spidma (
+    input clk,
+    input resetn,
+
+    input             reg_addr_we,
+    input             reg_ctrl_we,
+    input      [31:0] reg_di,
+    output     [31:0] reg_addr_do,
+    output            reg_wait,
+
+    output            busy,         // 1: DMA owns the RV memory port
+
+    // word transfer interface of the SPI masters
+    output reg        sd_word_we,
+    output reg        flash_word_we,
+    input      [31:0] sd_do,
+    input             sd_wait,
+    input      [31:0] flash_do,
+    input             flash_wait,
+
+    // RV memory port
+    output            mem_valid,
+    output     [22:0] mem_addr,
+    output     [31:0] mem_wdata,
+    input             mem_ready
+);
+
+reg active;
+reg flash;
+reg reg_ctrl_we_r;
+reg wait_buf = 1;
+reg [15:0] spi_left;            // bytes still to receive
+reg [22:0] addr;                // next RAM address
+reg [31:0] fifo [0:3];
+reg [1:0] rptr, wptr;
+reg [2:0] count;
+
+assign busy = active;
+assign reg_wait = wait_buf & reg_ctrl_we;
+assign reg_addr_do = {9'b0, addr};
+assign mem_valid = active && count != 3'd0;
+assign mem_addr = addr;
+assign mem_wdata = fifo[rptr];
+
+wire word_we = flash ? flash_word_we : sd_word_we;
+wire word_done = word_we && ~(flash ? flash_wait : sd_wait);
+
+always @(posedge clk) begin
+    if (~resetn) begin
+        active <= 0;
+        sd_word_we <= 0;
+        flash_word_we <= 0;
+        reg_ctrl_we_r <= 0;
+        rptr <= 0;
+        wptr <= 0;
+        count <= 0;
+    end else begin
+        reg [2:0] count_next;
+        count_next = count;
+        wait_buf <= 1;
+        reg_ctrl_we_r <= reg_ctrl_we;
+        if (reg_addr_we && ~active)
+            addr <= reg_di[22:0] & ~23'd3;
+
+        // start on the rising edge of the write, the CPU holds it until we finish
+        if (reg_ctrl_we && ~reg_ctrl_we_r) begin
+            if (reg_di[15:2] == 0)
+                wait_buf <= 0;
+            else begin
+                active <= 1;
+                flash <= reg_di[16];
+                spi_left <= {reg_di[15:2], 2'b0};
+            end
+        end
+
+        // SPI side: one word at a time, with a cycle of write enable low in
+        // between so the master sees a new request
+        if (word_done) begin
+            fifo[wptr] <= flash ? flash_do : sd_do;
+            wptr <= wptr + 2'd1;
+            count_next = count_next + 3'd1;
+            spi_left <= spi_left - 16'd4;
+            sd_word_we <= 0;
+            flash_word_we <= 0;
+        end else if (active && ~word_we && spi_left != 0 && count != 3'd4) begin
+            sd_word_we <= ~flash;
+            flash_word_we <= flash;
+        end
+
+        // RAM side
+        if (mem_valid && mem_ready) begin
+            rptr <= rptr + 2'd1;
+            count_next = count_next - 3'd1;
+            addr <= addr + 23'd4;
+        end
+        count <= count_next;
+
+        // all in RAM, let the CPU continue
+        if (active && spi_left == 0 && count_next == 0 && ~word_we) begin
+            active <= 0;
+            wait_buf <= 0;
+        end
+    end
+end
+
+endmodule
@@ -54,8 +54,8 @@ reg wait_buf = 1;
 reg reg_byte_we_r, reg_word_we_r;
 reg active, new_request;
 
-SPI_Master #(.CLKS_PER_HALF_BIT(CLK_DIV)) spi (
-  .i_Clk(clk), .i_Rst_L(resetn),
+SPI_Master spi (
+  .i_Clk(clk), .i_Rst_L(resetn), .i_Clks_Per_Half_Bit(CLK_DIV),
   .i_TX_Byte(data_in), .i_TX_DV(spi_start), .o_TX_Ready(spi_ready),
   .o_RX_DV(), .o_RX_Byte(data_out),
   .o_SPI_Clk(sck), .i_SPI_MISO(miso), .o_SPI_MOSI(mosi)
@@ -0,0 +1,140 @@
+// bus-compatible stand-in for jt12.v, for fast simulation without audio (AUDIO_STUB)
+//
+// Keeps what the Z80/68K can observe: the address/data latch, the busy flag
+// (32 synth cycles after a data write) and timer A/B with their flags and
+// irq_n, using the original jt12_timers. The whole operator/envelope/mixing
+// pipeline is left out, so snd_left/snd_right are always 0.
+//
+// Timing follows jt12_top with the YM2612 defaults (mask_div=1): the synth
+// clock is cen/6, and timers advance once per 24 synth cycles (one "zero"
+// pulse per 6 channels x 4 operators).
+
+module jt12_stub (
+    input           rst,
+    input           clk,
+    input           cen,
+    input   [7:0]   din,
+    input   [1:0]   addr,
+    input           cs_n,
+    input           wr_n,
+
+    output reg [7:0] dout,
+    output          irq_n,
+    // configuration
+    input           en_hifi_pcm,
+    input           ladder,
+    // combined output
+    output  signed  [15:0]  snd_right,
+    output  signed  [15:0]  snd_left,
+    output          snd_sample
+);
+
+assign snd_right  = 16'd0;
+assign snd_left   = 16'd0;
+assign snd_sample = 1'b0;
+
+wire write = !cs_n && !wr_n;
+
+// synth clock: cen/6 (jt12_div with div_setting=2'b10)
+reg [2:0] pres;
+reg       clk_en;
+always @(posedge clk) begin
+    clk_en <= 1'b0;
+    if (rst)
+        pres <= 3'd0;
+    else if (cen) begin
+        pres <= pres == 3'd5 ? 3'd0 : pres + 3'd1;
+        clk_en <= pres == 3'd0;
+    end
+end
+
+// slot counter, replaces jt12_reg's {cur_op, cur_ch} sequence
+reg [4:0] slot;
+always @(posedge clk) begin
+    if (rst)
+        slot <= 5'd0;
+    else if (clk_en)
+        slot <= slot == 5'd23 ? 5'd0 : slot + 5'd1;
+end
+wire zero = slot == 5'd0;
+
+// timer related registers, same decoding as jt12_mmr
+reg [7:0] selected_register;
+reg       part;
+reg [9:0] value_A;
+reg [7:0] value_B;
+reg       load_A, load_B, enable_irq_A, enable_irq_B;
+reg       clr_flag_A, clr_flag_B;
+reg       fast_timers;
+
+always @(posedge clk) begin
+    if (rst) begin
+        selected_register <= 8'h0;
+        part <= 1'b0;
+        { value_A, value_B } <= 18'd0;
+        { clr_flag_B, clr_flag_A,
+          enable_irq_B, enable_irq_A, load_B, load_A } <= 6'd0;
+        fast_timers <= 1'b0;
+    end else if (write) begin
+        if (!addr[0]) begin
+            selected_register <= din;
+            part <= addr[1];
+        end else if (!part) begin
+            case (selected_register)
+            8'h21: fast_timers <= din[2];
+            8'h24: value_A[9:2] <= din;
+            8'h25: value_A[1:0] <= din[1:0];
+            8'h26: value_B <= din;
+            8'h27: { clr_flag_B, clr_flag_A,
+                     enable_irq_B, enable_irq_A,
+                     load_B, load_A } <= din[5:0];
+            default:;
+            endcase
+        end
+    end else if (clk_en)
+        { clr_flag_B, clr_flag_A } <= 2'd0;       // once-only bits
+end
+
+// busy lasts for 32 synth clock cycles
+reg       old_write;
+reg       busy;
+reg [4:0] busy_cnt;
+always @(posedge clk) begin
+    old_write <= write;
+    if (rst) begin
+        busy <= 1'b0;
+        busy_cnt <= 5'd0;
+    end else if (!old_write && write && addr[0]) begin
+        busy <= 1'b1;
+        busy_cnt <= 5'd0;
+    end else if (clk_en) begin
+        if (busy_cnt == 5'd31) busy <= 1'b0;
+        busy_cnt <= busy_cnt + 5'd1;
+    end
+end
+
+wire flag_A, flag_B;
+jt12_timers #(.num_ch(6)) u_timers (
+    .clk        ( clk           ),
+    .clk_en     ( fast_timers ? cen : clk_en ),
+    .rst        ( rst           ),
+    .zero       ( zero          ),
+    .value_A    ( value_A       ),
+    .value_B    ( value_B       ),
+    .load_A     ( load_A        ),
+    .load_B     ( load_B        ),
+    .enable_irq_A( enable_irq_A ),
+    .enable_irq_B( enable_irq_B ),
+    .clr_flag_A ( clr_flag_A    ),
+    .clr_flag_B ( clr_flag_B    ),
+    .flag_A     ( flag_A        ),
+    .flag_B     ( flag_B        ),
+    .overflow_A (               ),
+    .irq_n      ( irq_n         )
+);
+
+// status register, same for all addresses on YM2612 (jt12_dout)
+always @(posedge clk)
+    dout <= { busy, 5'd0, flag_B, flag_A };
+
+endmodule
@@ -18,10 +18,10 @@ module mdtang_top (
     // MicroSD
     output sd_clk,
     inout  sd_cmd,                  // MOSI
-    input  sd_dat0,                 // MISO
-    output sd_dat1,
-    output sd_dat2,
-    output sd_dat3,
+    inout  sd_dat0,                 // MISO
+    inout  sd_dat1,
+    inout  sd_dat2,
+    inout  sd_dat3,
 
     // SPI flash
     output flash_spi_cs_n,          // chip select
@@ -108,7 +108,11 @@ wire [11:0] hid1, hid2;
 localparam FREQ = 53_750_000;
 
 // reset logic
+`ifdef SIM_NO_PUBLIC
+reg        reset = 1;
+`else
 reg        reset /* verilator public */ = 1;
+`endif
 reg [15:0]  reset_cnt = 65535;
 always @(posedge clk_sys) begin
     if (reset_cnt != 0) reset_cnt <= reset_cnt - '1;
@@ -118,7 +122,9 @@ always @(posedge clk_sys) begin
 end
 
 
+`ifndef SIM_NO_PUBLIC
 /* verilator public_on */
+`endif
 reg        md_on;
 wire [1:0] resolution;          // {V30, H40}, V30: verticle 240 vs 224, H40: horizontal 320 vs 256
 wire ce_pix, hblank, vblank, hsync;
@@ -127,7 +133,9 @@ wire [3:0] red   /* xsynthesis syn_keep=1 */,
            green /* xsynthesis syn_keep=1 */, 
            blue  /* xsynthesis syn_keep=1 */;
 wire [15:0] audio_left, audio_right;
+`ifndef SIM_NO_PUBLIC
 /* verilator public_off */
+`endif
 
 wire [24:1] mem_addr;
 wire [15:0] mem_data, mem_wdata;
@@ -180,6 +188,58 @@ end
 
 `ifdef VERILATOR
 
+// DPI accessors for sim_main.cpp and debug tools (see verilator/sim_dpi.h).
+// They use hierarchical references, so they keep working when the
+// `verilator public` pragmas are compiled out with SIM_NO_PUBLIC.
+export "DPI-C" function md_status;
+export "DPI-C" function md_video;
+export "DPI-C" function md_audio;
+export "DPI-C" function md_vram_read;
+export "DPI-C" function md_cram_read;
+export "DPI-C" function md_vsram_read;
+export "DPI-C" function md_vdp_reg;
+
+// {reset, md_on}
+function int md_status();
+    return {30'b0, reset, md_on};
+endfunction
+
+// {resolution[1:0], vblank, hblank, hsync, ce_pix, red[3:0], green[3:0], blue[3:0]}
+function int md_video();
+    return {14'b0, resolution, vblank, hblank, hsync, ce_pix, red, green, blue};
+endfunction
+
+// {audio_left, audio_right}
+function int md_audio();
+    return {audio_left, audio_right};
+endfunction
+
+// VRAM word (0-32767). Even words are in vram_*1, odd words in vram_*2.
+function int md_vram_read(input int addr);
+    if (addr[0])
+        return {16'b0, megadrive.vram_u2.mem[addr[14:1]], megadrive.vram_l2.mem[addr[14:1]]};
+    else
+        return {16'b0, megadrive.vram_u1.mem[addr[14:1]], megadrive.vram_l1.mem[addr[14:1]]};
+endfunction
+
+// CRAM entry (0-63) as stored by the VDP: {B[2:0], G[2:0], R[2:0]}
+function int md_cram_read(input int addr);
+    return {16'b0, megadrive.vdp.cram.ram[addr[5:0]]};
+endfunction
+
+// VSRAM entry (0-39), 11 bits
+function int md_vsram_read(input int addr);
+    if (addr[0])
+        return {16'b0, megadrive.vdp.vsram1.ram[addr[5:1]]};
+    else
+        return {16'b0, megadrive.vdp.vsram0.ram[addr[5:1]]};
+endfunction
+
+// VDP register (0-31)
+function int md_vdp_reg(input int addr);
+    return {24'b0, megadrive.vdp.REG[addr[4:0]]};
+endfunction
+
 sdram_sim u_sdram (
     .clk(clk_sys), .resetn(1'b1), .busy(sdram_busy),
     .addr0(mem_addr), .req0(mem_req), .ack0(mem_ack), .wr0(mem_we), .be0(mem_be),
@@ -41,6 +41,7 @@
 // 3. No SVP, EEPROM or GameGenie for now.
 //
 // `define NO_SOUND
+// `define AUDIO_STUB	// keep YM2612 status/timers but generate no samples (fast simulation)
 
 module system
 (
@@ -533,7 +534,10 @@ vdp vdp
 
 // PSG 0x10-0x17 in VDP space
 wire signed [10:0] PSG_SND;
-`ifndef NO_SOUND
+`ifdef AUDIO_STUB
+assign PSG_SND = 0;			// PSG is write-only, nothing to keep
+`elsif NO_SOUND
+`else
 jt89 psg
 (
 	.rst(reset),
@@ -1528,7 +1532,25 @@ wire signed [15:0] FM_LPF_left;
 wire signed [15:0] PRE_LPF_L;
 wire signed [15:0] PRE_LPF_R;
 
-`ifndef NO_SOUND
+`ifdef AUDIO_STUB
+jt12_stub fm
+(
+	.rst(~Z80_RESET_N),
+	.clk(MCLK),
+	.cen(FM_CLKEN),
+
+	.cs_n(0),
+	.addr(ZBUS_A[1:0]),
+	.wr_n(~(FM_SEL & ZBUS_WE)),
+	.din(ZBUS_DO),
+	.dout(FM_DO),
+	.en_hifi_pcm( EN_HIFI_PCM ),
+	.ladder(LADDER),
+	.snd_left(FM_left),
+	.snd_right(FM_right)
+);
+`elsif NO_SOUND
+`else
 jt12 fm
 (
 	.rst(~Z80_RESET_N),
@@ -1550,6 +1572,7 @@ jt12 fm
 wire signed [15:0] fm_adjust_l = (FM_left  << 4) + (FM_left  << 2) + (FM_left  << 1) + (FM_left  >>> 2);
 wire signed [15:0] fm_adjust_r = (FM_right << 4) + (FM_right << 2) + (FM_right << 1) + (FM_right >>> 2);
 
+`ifndef AUDIO_STUB
 `ifndef NO_SOUND
 genesis_fm_lpf fm_lpf_l
 (
@@ -1567,13 +1590,18 @@ genesis_fm_lpf fm_lpf_r
 	.out(FM_LPF_right)
 );
 `endif
+`endif
 
 wire signed [15:0] fm_select_l = ((LPF_MODE == 2'b01) ? FM_LPF_left : fm_adjust_l);
 wire signed [15:0] fm_select_r = ((LPF_MODE == 2'b01) ? FM_LPF_right : fm_adjust_r);
 
 wire signed [10:0] psg_adjust = PSG_SND - (PSG_SND >>> 5);
 
-`ifndef NO_SOUND
+`ifdef AUDIO_STUB
+assign DAC_LDATA = 0;
+assign DAC_RDATA = 0;
+`elsif NO_SOUND
+`else
 jt12_genmix genmix
 (
 	.rst(reset),
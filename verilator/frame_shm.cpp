@@ -0,0 +1,63 @@
+#include "frame_shm.h"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+bool FrameShmWriter::open(const char *shm_name)
+{
+	name = shm_name;
+	int fd = shm_open(shm_name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		perror("shm_open");
+		return false;
+	}
+	if (ftruncate(fd, sizeof(frame_shm)) < 0) {
+		perror("ftruncate");
+		::close(fd);
+		return false;
+	}
+	void *p = mmap(NULL, sizeof(frame_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		return false;
+	}
+	shm = (frame_shm *)p;
+	memset(shm, 0, sizeof(frame_shm));
+	shm->version = FRAME_SHM_VERSION;
+	shm->slots = FRAME_SHM_SLOTS;
+	shm->width = FRAME_SHM_W;
+	shm->height = FRAME_SHM_H;
+	__atomic_store_n(&shm->magic, FRAME_SHM_MAGIC, __ATOMIC_RELEASE);
+	printf("Publishing frames to shared memory %s\n", shm_name);
+	return true;
+}
+
+void FrameShmWriter::publish(const uint16_t *pixels, uint32_t frame, uint64_t sim_time, int resolution)
+{
+	if (!shm) return;
+	uint32_t idx = (shm->latest + 1) % FRAME_SHM_SLOTS;
+	frame_shm_slot *s = &shm->slot[idx];
+
+	uint32_t seq = s->seq;
+	__atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);		// odd: being written
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	s->frame = frame;
+	s->sim_time = sim_time;
+	s->resolution = resolution;
+	s->width = resolution & 1 ? 320 : 256;
+	s->height = FRAME_SHM_H;			// V30 is clamped, the simulator renders 224 lines
+	memcpy(s->pixels, pixels, sizeof(s->pixels));
+	__atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&shm->latest, idx, __ATOMIC_RELEASE);
+}
+
+void FrameShmWriter::close()
+{
+	if (!shm) return;
+	munmap(shm, sizeof(frame_shm));
+	shm_unlink(name.c_str());
+	shm = nullptr;
+}
@@ -0,0 +1,91 @@
+// Shared-memory frame export, see --shm in sim_main.cpp.
+//
+// The simulator publishes every completed frame into a small ring of slots in
+// a POSIX shared-memory object. Each slot is guarded by a seqlock, so any number
+// of readers can attach (read-only) without ever blocking the simulator:
+//
+//   int fd = shm_open("/mdtang", O_RDONLY, 0);
+//   const struct frame_shm *shm = mmap(NULL, sizeof(struct frame_shm), PROT_READ, MAP_SHARED, fd, 0);
+//   struct frame_shm_slot copy;
+//   if (frame_shm_read(shm, &copy)) ...
+//
+// Readers that want zero-copy access can work on shm->slot[] directly and
+// check frame_shm_begin()/frame_shm_valid() around their access.
+//
+// The layout and reader helpers are plain C so external tools can include
+// this header as is.
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define FRAME_SHM_MAGIC		0x4e54444d		// "MDTN"
+#define FRAME_SHM_VERSION	1
+#define FRAME_SHM_SLOTS		4
+#define FRAME_SHM_W			320
+#define FRAME_SHM_H			224
+
+struct frame_shm_slot {
+	uint32_t seq;					// seqlock, odd while the simulator writes the slot
+	uint32_t frame;					// frame number
+	uint64_t sim_time;
+	uint16_t width, height;			// active picture size, from resolution; height is
+									// clamped to FRAME_SHM_H, V30 shows the first 224 lines
+	uint8_t  resolution;			// {V30, H40} as output by the core
+	uint8_t  pad[7];
+	uint16_t pixels[FRAME_SHM_H][FRAME_SHM_W];	// RGB444, R in bits 11-8
+};
+
+struct frame_shm {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slots, width, height;	// FRAME_SHM_SLOTS, FRAME_SHM_W, FRAME_SHM_H
+	uint32_t latest;				// slot of the most recently completed frame
+	struct frame_shm_slot slot[FRAME_SHM_SLOTS];
+};
+
+// start of a zero-copy read, returns the sequence to pass to frame_shm_valid()
+static inline uint32_t frame_shm_begin(const struct frame_shm_slot *s)
+{
+	return __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+}
+
+// nonzero if the slot was not touched since frame_shm_begin()
+static inline int frame_shm_valid(const struct frame_shm_slot *s, uint32_t seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return !(seq & 1) && __atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq;
+}
+
+// copy the latest complete frame, returns 0 if no frame could be read
+static inline int frame_shm_read(const struct frame_shm *shm, struct frame_shm_slot *out)
+{
+	for (int tries = 0; tries < 16; tries++) {
+		const struct frame_shm_slot *s = &shm->slot[__atomic_load_n(&shm->latest, __ATOMIC_ACQUIRE) % FRAME_SHM_SLOTS];
+		uint32_t seq = frame_shm_begin(s);
+		if (seq == 0 || (seq & 1))
+			continue;
+		memcpy(out, s, sizeof(*out));
+		if (frame_shm_valid(s, seq))
+			return 1;
+	}
+	return 0;
+}
+
+#ifdef __cplusplus
+#include <string>
+
+// simulator side, see frame_shm.cpp
+class FrameShmWriter {
+public:
+	~FrameShmWriter() { close(); }
+
+	bool open(const char *shm_name);		// e.g. "/mdtang"
+	void publish(const uint16_t *pixels, uint32_t frame, uint64_t sim_time, int resolution);
+	void close();
+
+private:
+	frame_shm *shm = nullptr;
+	std::string name;
+};
+#endif
@@ -0,0 +1,224 @@
+// fx68k test harness with a flat 16MB memory (fx68k_tb.sv).
+//
+// The test binary is loaded at address 0 (or -b), so it should start with the
+// reset vectors (SSP, PC). The program ends the test by writing a word to
+// EXIT_PORT (0 = pass). Bytes written to PUTC_PORT are printed to stdout.
+// Otherwise the run stops at the cycle limit (-c) or on a double bus fault.
+//
+// With -e, the final state is compared against an expectations file:
+//   # comment
+//   D0 00000001                  register (D0-D7, A0-A7, USP, SSP, SR)
+//   MEM 00ff0000 0012abcd        bytes at address, as a hex string
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Vfx68k_tb.h"
+#include "Vfx68k_tb__Dpi.h"
+#include "svdpi.h"
+#include "verilated.h"
+
+using namespace std;
+
+const uint32_t MEM_SIZE = 16 * 1024 * 1024;
+const uint32_t EXIT_PORT = 0xe00000;
+const uint32_t PUTC_PORT = 0xe00002;
+
+Vfx68k_tb *top = new Vfx68k_tb;
+vector<uint8_t> mem(MEM_SIZE);
+uint64_t clks;
+
+const char *reg_names[] = {"D0", "D1", "D2", "D3", "D4", "D5", "D6", "D7",
+						   "A0", "A1", "A2", "A3", "A4", "A5", "A6", "A7",
+						   "USP", "SSP", "PC", "SR"};
+
+void usage()
+{
+	printf("Usage: fx68k [options] <test.bin>\n");
+	printf("  -b ADDR   load address (hex, default 0)\n");
+	printf("  -w N      wait states per bus cycle, in CPU cycles (default 0)\n");
+	printf("  -c N      stop after N CPU cycles (default 100000000)\n");
+	printf("  -e FILE   compare final registers/memory against FILE\n");
+}
+
+static void tick()
+{
+	top->clk = 1;
+	top->eval();
+	top->clk = 0;
+	top->eval();
+	clks++;
+}
+
+void dump_regs()
+{
+	for (int i = 0; i < 20; i++)
+		printf("%-3s %08x%s", reg_names[i], (uint32_t)fx68k_reg(i), i % 4 == 3 ? "\n" : "  ");
+}
+
+// returns number of mismatches, or -1 if the file cannot be read
+int check_expect(const char *fname)
+{
+	FILE *f = fopen(fname, "r");
+	if (!f) {
+		printf("Cannot open %s\n", fname);
+		return -1;
+	}
+	int errors = 0;
+	char line[1024], name[16], val[1000];
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' || sscanf(line, "%15s %999s", name, val) != 2)
+			continue;
+		if (strcmp(name, "MEM") == 0) {
+			uint32_t addr = strtoul(val, NULL, 16);
+			char bytes[1000];
+			if (sscanf(line, "%*s %*s %999s", bytes) != 1) continue;
+			for (size_t i = 0; i + 1 < strlen(bytes); i += 2) {
+				uint8_t exp = strtoul(string(bytes + i, 2).c_str(), NULL, 16);
+				uint8_t got = mem[(addr + i / 2) % MEM_SIZE];
+				if (exp != got) {
+					printf("MISMATCH: MEM %06x = %02x, expected %02x\n", addr + (uint32_t)i / 2, got, exp);
+					errors++;
+				}
+			}
+			continue;
+		}
+		int r = -1;
+		for (int i = 0; i < 20; i++)
+			if (strcasecmp(name, reg_names[i]) == 0) r = i;
+		if (r < 0 || r == 18) {				// PC is the prefetch PC, not comparable
+			printf("Ignoring expectation: %s", line);
+			continue;
+		}
+		uint32_t exp = strtoul(val, NULL, 16), got = fx68k_reg(r);
+		if (r == 19) exp &= 0xffff;
+		if (exp != got) {
+			printf("MISMATCH: %s = %08x, expected %08x\n", reg_names[r], got, exp);
+			errors++;
+		}
+	}
+	fclose(f);
+	return errors;
+}
+
+int main(int argc, char **argv, char **env)
+{
+	Verilated::commandArgs(argc, argv);
+	const char *bin_file = NULL, *expect_file = NULL;
+	uint32_t base = 0;
+	int wait_states = 0;
+	uint64_t max_cycles = 100000000;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+			base = strtoul(argv[++i], NULL, 16);
+		else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+			wait_states = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+			max_cycles = strtoull(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+			expect_file = argv[++i];
+		else if (argv[i][0] == '-') {
+			printf("Unrecognized option: %s\n", argv[i]);
+			usage();
+			exit(1);
+		} else
+			bin_file = argv[i];
+	}
+	if (!bin_file) {
+		usage();
+		exit(1);
+	}
+
+	FILE *f = fopen(bin_file, "rb");
+	if (!f) {
+		printf("Cannot open file %s\n", bin_file);
+		exit(1);
+	}
+	size_t size = fread(&mem[base % MEM_SIZE], 1, MEM_SIZE - base % MEM_SIZE, f);
+	fclose(f);
+	printf("Loaded %zu bytes at %06x\n", size, base);
+
+	svSetScope(svGetScopeFromName("TOP.fx68k_tb"));
+
+	top->DTACKn = 1;
+	top->VPAn = 1;
+	top->BERRn = 1;
+	top->IPLn = 7;
+	top->reset = 1;
+	for (int i = 0; i < 32; i++) tick();
+	top->reset = 0;
+	clks = 0;
+
+	auto start = chrono::steady_clock::now();
+	bool acked = false, done = false;
+	int wait_cnt = 0, exit_code = -1;
+	while (!done && clks / 2 < max_cycles) {
+		tick();
+
+		if (!top->oHALTEDn) {
+			printf("CPU halted (double bus fault)\n");
+			break;
+		}
+
+		// bus cycle
+		if (top->ASn) {
+			top->DTACKn = 1;
+			top->VPAn = 1;
+			acked = false;
+			wait_cnt = 0;
+		} else if (!acked && (!top->UDSn || !top->LDSn)) {
+			if (top->FC == 7) {				// interrupt acknowledge: autovector
+				top->VPAn = 0;
+				acked = true;
+			} else if (wait_cnt < wait_states * 2) {
+				wait_cnt++;
+			} else {
+				uint32_t addr = (top->eab << 1) % MEM_SIZE;
+				if (top->eRWn) {
+					top->iEdb = mem[addr] << 8 | mem[addr + 1];
+				} else {
+					if (addr == EXIT_PORT) {
+						exit_code = top->oEdb;
+						done = true;
+					} else if (addr == PUTC_PORT) {
+						putchar(top->oEdb & 0xff);
+						fflush(stdout);
+					}
+					if (!top->UDSn) mem[addr] = top->oEdb >> 8;
+					if (!top->LDSn) mem[addr + 1] = top->oEdb & 0xff;
+				}
+				top->DTACKn = 0;
+				acked = true;
+			}
+		}
+	}
+	double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	printf("\n");
+	dump_regs();
+	uint64_t instrs = top->instructions, cycles = clks / 2;
+	printf("Instructions: %llu, CPU cycles: %llu, time: %.2fs\n",
+		   (unsigned long long)instrs, (unsigned long long)cycles, secs);
+	printf("Throughput: %.0f instructions/s, %.2f MHz equivalent\n", instrs / secs, cycles / secs / 1e6);
+
+	bool pass = true;
+	if (!done) {
+		printf("Test did not finish (no write to exit port %06x)\n", EXIT_PORT);
+		pass = false;
+	} else if (exit_code != 0) {
+		printf("Test reported failure code %d\n", exit_code);
+		pass = false;
+	}
+	if (expect_file && check_expect(expect_file) != 0)
+		pass = false;
+	printf("%s\n", pass ? "PASS" : "FAIL");
+
+	top->final();
+	delete top;
+	return pass ? 0 : 1;
+}
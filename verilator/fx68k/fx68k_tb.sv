@@ -0,0 +1,62 @@
+// fx68k harness: the CPU with its bus brought out to fx68k_main.cpp, which
+// provides a flat memory. One clk is one CPU phase (2 clks per CPU cycle).
+module fx68k_tb (
+    input clk,
+    input reset,                    // power-up reset
+
+    input DTACKn,
+    input VPAn,
+    input BERRn,
+    input [2:0] IPLn,
+    input [15:0] iEdb,
+    output [15:0] oEdb,
+    output [23:1] eab,
+    output eRWn, ASn, UDSn, LDSn,
+    output [2:0] FC,
+    output oHALTEDn,
+
+    output reg [63:0] instructions  // number of instructions started
+);
+
+reg phi;
+always @(posedge clk)
+    phi <= reset ? 1'b0 : ~phi;
+
+fx68k cpu (
+    .clk(clk), .HALTn(1'b1),
+    .extReset(reset), .pwrUp(reset),
+    .enPhi1(~phi), .enPhi2(phi),
+    .eRWn(eRWn), .ASn(ASn), .LDSn(LDSn), .UDSn(UDSn), .E(), .VMAn(),
+    .FC0(FC[0]), .FC1(FC[1]), .FC2(FC[2]),
+    .BGn(), .oRESETn(), .oHALTEDn(oHALTEDn),
+    .DTACKn(DTACKn), .VPAn(VPAn), .BERRn(BERRn),
+    .BRn(1'b1), .BGACKn(1'b1),
+    .IPL0n(IPLn[0]), .IPL1n(IPLn[1]), .IPL2n(IPLn[2]),
+    .iEdb(iEdb), .oEdb(oEdb), .eab(eab)
+);
+
+// an instruction starts when IR is moved to IRD
+always @(posedge clk)
+    if (reset)
+        instructions <= 0;
+    else if (cpu.enT1 & cpu.Nanod_Ir2Ird)
+        instructions <= instructions + 1;
+
+// register access for fx68k_main.cpp
+// 0-7: D0-D7, 8-15: A0-A7 (A7 is the active stack pointer), 16: USP, 17: SSP, 18: PC, 19: SR
+export "DPI-C" function fx68k_reg;
+function int fx68k_reg(input int r);
+    if (r < 15)
+        return {cpu.excUnit.regs68H[r[4:0]], cpu.excUnit.regs68L[r[4:0]]};
+    else if (r == 15)
+        return cpu.pswS ? {cpu.excUnit.regs68H[16], cpu.excUnit.regs68L[16]}
+                        : {cpu.excUnit.regs68H[15], cpu.excUnit.regs68L[15]};
+    else if (r == 16 || r == 17)
+        return {cpu.excUnit.regs68H[r[4:0] - 5'd1], cpu.excUnit.regs68L[r[4:0] - 5'd1]};
+    else if (r == 18)
+        return cpu.excUnit.PC;
+    else
+        return {16'b0, cpu.psw};
+endfunction
+
+endmodule
@@ -0,0 +1,170 @@
+#include "recorder.h"
+
+#include <cstring>
+
+static void put16(FILE *f, uint16_t v) { fputc(v & 0xff, f); fputc(v >> 8, f); }
+static void put32(FILE *f, uint32_t v) { put16(f, v & 0xffff); put16(f, v >> 16); }
+
+// 48Khz 16-bit stereo, sizes are patched in close()
+static void write_wav_header(FILE *f, uint32_t data_bytes)
+{
+	fwrite("RIFF", 1, 4, f); put32(f, 36 + data_bytes);
+	fwrite("WAVEfmt ", 1, 8, f); put32(f, 16);
+	put16(f, 1); put16(f, 2);				// PCM, stereo
+	put32(f, 48000); put32(f, 48000 * 4);
+	put16(f, 4); put16(f, 16);
+	fwrite("data", 1, 4, f); put32(f, data_bytes);
+}
+
+bool Recorder::open(const char *target, int w, int h)
+{
+	width = w;
+	height = h;
+	std::string audio_name;
+	if (target[0] == '|') {
+		piped = true;
+		video = popen(target + 1, "w");
+		audio_name = "record.wav";
+	} else {
+		std::string name = target;
+		y4m = name.size() > 4 && name.compare(name.size() - 4, 4, ".y4m") == 0;
+		video = fopen(target, "wb");
+		audio_name = (y4m ? name.substr(0, name.size() - 4) : name) + ".wav";
+	}
+	if (!video) {
+		printf("Cannot open %s for recording\n", target);
+		return false;
+	}
+	audio = fopen(audio_name.c_str(), "wb");
+	if (audio)
+		write_wav_header(audio, 0);
+
+	if (y4m)
+		fprintf(video, "YUV4MPEG2 W%d H%d F60000:1001 Ip A1:1 C444\n", width, height);
+	if (piped)
+		printf("Recording raw rgb24 %dx%d frames to pipe\n", width, height);
+	else
+		printf("Recording %s video to %s\n", y4m ? "y4m" : "raw rgb24", target);
+	if (audio)
+		printf("Recording audio to %s\n", audio_name.c_str());
+
+	writer = std::thread(&Recorder::writer_loop, this);
+	return true;
+}
+
+void Recorder::add_audio(int16_t left, int16_t right)
+{
+	if (!video) return;
+	pending_audio.push_back(left);
+	pending_audio.push_back(right);
+}
+
+void Recorder::push_frame(const uint16_t *rgb444)
+{
+	if (!video) return;
+	std::unique_lock<std::mutex> l(lock);
+	if (queue.size() >= QUEUE_MAX) {
+		// repeat the last queued frame instead, with this frame's audio
+		Frame &last = queue.back();
+		last.repeat++;
+		last.audio.insert(last.audio.end(), pending_audio.begin(), pending_audio.end());
+		pending_audio.clear();
+		dropped++;
+		return;
+	}
+	queue.emplace_back();
+	Frame &f = queue.back();
+	f.pixels.assign(rgb444, rgb444 + width * height);
+	f.audio.swap(pending_audio);
+	l.unlock();
+	cond.notify_one();
+}
+
+void Recorder::writer_loop()
+{
+	for (;;) {
+		std::unique_lock<std::mutex> l(lock);
+		cond.wait(l, [this] { return closing || !queue.empty(); });
+		if (queue.empty())
+			return;			// closing and drained
+		Frame f = std::move(queue.front());
+		queue.pop_front();
+		l.unlock();
+		write_frame(f);
+	}
+}
+
+void Recorder::write_frame(const Frame &f)
+{
+	static uint8_t yuv[4096][3];
+	static bool yuv_ready;
+	int n = width * height;
+
+	if (f.pixels.empty()) {
+		// audio only
+	} else if (y4m) {
+		if (!yuv_ready) {		// BT.601 limited range
+			for (int c = 0; c < 4096; c++) {
+				int r = (c >> 8) * 0x11, g = ((c >> 4) & 0xf) * 0x11, b = (c & 0xf) * 0x11;
+				yuv[c][0] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+				yuv[c][1] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+				yuv[c][2] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+			}
+			yuv_ready = true;
+		}
+		line_buf.resize(n * 3);
+		for (int plane = 0; plane < 3; plane++)
+			for (int i = 0; i < n; i++)
+				line_buf[plane * n + i] = yuv[f.pixels[i] & 0xfff][plane];
+		for (int r = 0; r <= f.repeat; r++) {
+			fwrite("FRAME\n", 1, 6, video);
+			fwrite(line_buf.data(), 1, n * 3, video);
+		}
+	} else {
+		line_buf.resize(n * 3);
+		for (int i = 0; i < n; i++) {
+			uint16_t c = f.pixels[i];
+			line_buf[i * 3] = (c >> 8 & 0xf) * 0x11;
+			line_buf[i * 3 + 1] = (c >> 4 & 0xf) * 0x11;
+			line_buf[i * 3 + 2] = (c & 0xf) * 0x11;
+		}
+		for (int r = 0; r <= f.repeat; r++)
+			fwrite(line_buf.data(), 1, n * 3, video);
+	}
+
+	if (audio && !f.audio.empty()) {
+		for (int16_t s : f.audio)
+			put16(audio, s);
+		audio_samples += f.audio.size() / 2;
+	}
+	if (!f.pixels.empty())
+		frames += 1 + f.repeat;
+}
+
+void Recorder::close()
+{
+	if (!video) return;
+	{
+		std::lock_guard<std::mutex> l(lock);
+		if (!pending_audio.empty()) {		// audio after the last frame
+			queue.emplace_back();
+			queue.back().audio.swap(pending_audio);
+		}
+		closing = true;
+	}
+	cond.notify_one();
+	writer.join();
+
+	if (piped)
+		pclose(video);
+	else
+		fclose(video);
+	video = nullptr;
+	if (audio) {
+		fseek(audio, 0, SEEK_SET);
+		write_wav_header(audio, audio_samples * 4);
+		fclose(audio);
+		audio = nullptr;
+	}
+	printf("Recording done: %lld frames written, %lld dropped and repeated\n", frames, dropped);
+}
@@ -0,0 +1,62 @@
+// Asynchronous video/audio capture for the simulator.
+//
+// Completed frames (RGB444, see sim_main.cpp) and the audio samples produced
+// during that frame are handed to a background writer thread through a bounded
+// queue. The simulation never waits for the disk: when the queue is full the
+// frame is dropped and counted, and the previous frame is written again in its
+// place with its audio, so video and audio stay in sync.
+//
+// Targets:
+//   out.y4m       YUV 4:4:4 Y4M video, audio to out.wav
+//   "|command"    raw rgb24 frames piped to command (e.g. ffmpeg), audio to record.wav
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class Recorder {
+public:
+	~Recorder() { close(); }
+
+	bool open(const char *target, int width, int height);
+	bool is_open() const { return video != nullptr; }
+
+	// called from the sim loop
+	void add_audio(int16_t left, int16_t right);
+	void push_frame(const uint16_t *rgb444);
+
+	void close();
+
+private:
+	struct Frame {
+		std::vector<uint16_t> pixels;
+		std::vector<int16_t> audio;		// interleaved L/R
+		int repeat = 0;					// dropped frames after this one, written as copies
+	};
+
+	static const size_t QUEUE_MAX = 16;
+
+	void writer_loop();
+	void write_frame(const Frame &f);
+
+	int width = 0, height = 0;
+	bool y4m = false, piped = false;
+	FILE *video = nullptr;
+	FILE *audio = nullptr;
+	long long audio_samples = 0;
+	std::vector<int16_t> pending_audio;
+	std::vector<uint8_t> line_buf;
+
+	std::thread writer;
+	std::mutex lock;
+	std::condition_variable cond;
+	std::deque<Frame> queue;
+	bool closing = false;
+	long long frames = 0, dropped = 0;
+};
@@ -0,0 +1,274 @@
+#include "sd_card.h"
+
+#include <cstring>
+
+using namespace std;
+
+static uint8_t crc7(const vector<bool> &bits, int n)
+{
+	uint8_t crc = 0;
+	for (int i = 0; i < n; i++) {
+		bool fb = bits[i] ^ (crc >> 6 & 1);
+		crc = (crc << 1 & 0x7f) ^ (fb ? 0x09 : 0);
+	}
+	return crc;
+}
+
+static uint16_t crc16(uint16_t crc, bool d)
+{
+	bool fb = d ^ (crc >> 15);
+	return (crc << 1) ^ (fb ? 0x1021 : 0);
+}
+
+// card status for R1: CURRENT_STATE, READY_FOR_DATA, APP_CMD
+uint32_t SdCard::status() const
+{
+	int st = state == TRAN ? 4 : state == DATA ? 5 : state == RCV ? 6 : state;
+	return st << 9 | 1 << 8 | (app ? 1 << 5 : 0);
+}
+
+void SdCard::read_sector(uint32_t sector, uint8_t *buf)
+{
+	uint64_t off = (uint64_t)sector * 512;
+	memset(buf, 0, 512);
+	if (off + 512 <= image.size())
+		memcpy(buf, &image[off], 512);
+}
+
+void SdCard::write_sector(uint32_t sector, const uint8_t *buf)
+{
+	uint64_t off = (uint64_t)sector * 512;
+	if (off + 512 <= image.size())
+		memcpy(&image[off], buf, 512);
+}
+
+// 48-bit response with CRC7. R3 has all ones instead of index and CRC.
+void SdCard::respond(int idx, uint32_t payload, int busy)
+{
+	vector<bool> bits = {0, 0};
+	for (int i = 5; i >= 0; i--) bits.push_back(idx >> i & 1);
+	for (int i = 31; i >= 0; i--) bits.push_back(payload >> i & 1);
+	uint8_t crc = idx == 0x3f ? 0x7f : crc7(bits, 40);
+	for (int i = 6; i >= 0; i--) bits.push_back(crc >> i & 1);
+	bits.push_back(1);
+	respond_bits(bits, busy);
+}
+
+// response after NCR (2 clocks), optionally followed by busy on DAT0
+void SdCard::respond_bits(const vector<bool> &bits, int busy)
+{
+	cmd_q.insert(cmd_q.end(), 2, 1);
+	cmd_q.insert(cmd_q.end(), bits.begin(), bits.end());
+	if (busy) {
+		dat_q.clear();
+		dat_q.insert(dat_q.end(), 2 + bits.size() + 1, 0xf);
+		dat_q.insert(dat_q.end(), busy, 0xe);
+	}
+}
+
+// data block with start bit, CRC16 of each line and end bit, after gap clocks
+void SdCard::send_block(const uint8_t *data, int len, int gap)
+{
+	uint16_t crc[4] = {0, 0, 0, 0};
+	dat_q.insert(dat_q.end(), gap, 0xf);
+	dat_q.push_back(wide ? 0x0 : 0xe);
+	for (int i = 0; i < len; i++) {
+		if (wide) {
+			for (uint8_t nib : {(uint8_t)(data[i] >> 4), (uint8_t)(data[i] & 0xf)}) {
+				dat_q.push_back(nib);
+				for (int l = 0; l < 4; l++) crc[l] = crc16(crc[l], nib >> l & 1);
+			}
+		} else {
+			for (int b = 7; b >= 0; b--) {
+				bool bit = data[i] >> b & 1;
+				dat_q.push_back(0xe | bit);
+				crc[0] = crc16(crc[0], bit);
+			}
+		}
+	}
+	for (int b = 15; b >= 0; b--) {
+		uint8_t v = 0xe | (crc[0] >> b & 1);
+		if (wide) {
+			v = 0;
+			for (int l = 0; l < 4; l++) v |= (crc[l] >> b & 1) << l;
+		}
+		dat_q.push_back(v);
+	}
+	dat_q.push_back(0xf);
+}
+
+void SdCard::command(int idx, uint32_t arg)
+{
+	bool was_app = app;
+	app = false;
+	if (was_app) {
+		switch (idx) {
+		case 6:								// SET_BUS_WIDTH
+			wide = (arg & 3) == 2;
+			respond(idx, status());
+			return;
+		case 23:							// SET_WR_BLK_ERASE_COUNT
+			respond(idx, status());
+			return;
+		case 41:							// SD_SEND_OP_COND
+			if (++acmd41_count >= 3) state = READY;
+			respond(0x3f, (state == READY ? 0x80000000 : 0) | (arg & 0x40000000) | 0x00ff8000);
+			return;
+		}
+	}
+	switch (idx) {
+	case 0:									// GO_IDLE_STATE
+		state = IDLE;
+		wide = high_speed = multi = false;
+		acmd41_count = 0;
+		cmd_q.clear();
+		dat_q.clear();
+		break;
+	case 2: {								// ALL_SEND_CID
+		vector<bool> bits(136, 0);
+		for (int i = 2; i < 8; i++) bits[i] = 1;
+		bits[135] = 1;
+		state = IDENT;
+		respond_bits(bits);
+		break;
+	}
+	case 3:									// SEND_RELATIVE_ADDR (R6)
+		state = STBY;
+		respond(idx, (uint32_t)rca << 16 | (status() & 0x1fff));
+		break;
+	case 6: {								// SWITCH_FUNC, 64-byte status
+		uint8_t st[64] = {0};
+		st[13] = 0x03;						// group 1 supports functions 0 and 1
+		st[16] = (arg & 0xf) == 1 ? 0x01 : 0x00;
+		if (arg >> 31 && (arg & 0xf) == 1) high_speed = true;
+		respond(idx, status());
+		send_block(st, 64, 2 + 48 + 2);
+		break;
+	}
+	case 7:									// SELECT_CARD (R1b)
+		if (arg >> 16 == rca) {
+			state = TRAN;
+			respond(idx, status(), 8);
+		}
+		break;
+	case 8:									// SEND_IF_COND (R7)
+		respond(idx, arg & 0xfff);
+		break;
+	case 12:								// STOP_TRANSMISSION (R1b)
+		state = TRAN;
+		multi = false;
+		rcv_n = -1;
+		respond(idx, status(), 16);
+		break;
+	case 13:								// SEND_STATUS
+		if (arg >> 16 == rca)
+			respond(idx, status());
+		break;
+	case 17:								// READ_SINGLE_BLOCK
+	case 18: {								// READ_MULTIPLE_BLOCK
+		uint8_t buf[512];
+		block = arg;
+		multi = idx == 18;
+		state = DATA;
+		respond(idx, status());
+		read_sector(block++, buf);
+		blocks_read++;
+		send_block(buf, 512, 2 + 48 + 2);
+		if (!multi) state = TRAN;
+		break;
+	}
+	case 24:								// WRITE_BLOCK
+	case 25:								// WRITE_MULTIPLE_BLOCK
+		block = arg;
+		multi = idx == 25;
+		state = RCV;
+		rcv_n = -1;
+		respond(idx, status());
+		break;
+	case 55:								// APP_CMD
+		app = true;
+		respond(idx, status());
+		break;
+	default:								// illegal command, no response
+		break;
+	}
+}
+
+void SdCard::rise(bool cmd, uint8_t dat)
+{
+	// command receiver
+	if (!cmd_rx && !cmd && cmd_q.empty()) {
+		cmd_rx = true;
+		cmd_n = 0;
+		cmd_bits = 0;
+	}
+	if (cmd_rx) {
+		cmd_bits = cmd_bits << 1 | cmd;
+		if (++cmd_n == 48) {
+			cmd_rx = false;
+			vector<bool> bits;
+			for (int i = 47; i >= 0; i--) bits.push_back(cmd_bits >> i & 1);
+			if (crc7(bits, 40) != (cmd_bits >> 1 & 0x7f))
+				cmd_crc_errors++;
+			else
+				command(cmd_bits >> 40 & 0x3f, cmd_bits >> 8);
+		}
+	}
+
+	// block receiver
+	if (state == RCV) {
+		int data_clks = wide ? 1024 : 4096;
+		if (rcv_n < 0) {
+			if (wide ? dat == 0 : !(dat & 1)) {
+				rcv_n = 0;
+				memset(rcv_buf, 0, sizeof(rcv_buf));
+				memset(rcv_crc, 0, sizeof(rcv_crc));
+				memset(rcv_crc_in, 0, sizeof(rcv_crc_in));
+			}
+		} else if (rcv_n < data_clks) {
+			if (wide) {
+				rcv_buf[rcv_n / 2] |= (dat & 0xf) << (rcv_n & 1 ? 0 : 4);
+				for (int l = 0; l < 4; l++) rcv_crc[l] = crc16(rcv_crc[l], dat >> l & 1);
+			} else {
+				rcv_buf[rcv_n / 8] |= (dat & 1) << (7 - rcv_n % 8);
+				rcv_crc[0] = crc16(rcv_crc[0], dat & 1);
+			}
+			rcv_n++;
+		} else if (rcv_n < data_clks + 16) {
+			for (int l = 0; l < 4; l++) rcv_crc_in[l] = rcv_crc_in[l] << 1 | (dat >> l & 1);
+			rcv_n++;
+		} else {							// end bit: CRC status token, then busy
+			bool ok = wide ? memcmp(rcv_crc, rcv_crc_in, sizeof(rcv_crc)) == 0 : rcv_crc[0] == rcv_crc_in[0];
+			dat_q.insert(dat_q.end(), 2, 0xf);
+			for (int b : ok ? vector<int>{0, 0, 1, 0, 1} : vector<int>{0, 1, 0, 1, 1})
+				dat_q.push_back(0xe | b);
+			dat_q.insert(dat_q.end(), 16, 0xe);
+			if (ok) {
+				write_sector(block++, rcv_buf);
+				blocks_written++;
+			} else
+				data_crc_errors++;
+			rcv_n = -1;
+			if (!multi) state = TRAN;
+		}
+	}
+}
+
+void SdCard::fall()
+{
+	cmd_line = 1;
+	if (!cmd_q.empty()) {
+		cmd_line = cmd_q.front();
+		cmd_q.pop_front();
+	}
+	dat_line = 0xf;
+	if (!dat_q.empty()) {
+		dat_line = dat_q.front();
+		dat_q.pop_front();
+	} else if (state == DATA && multi) {	// next block of a multiple block read
+		uint8_t buf[512];
+		read_sector(block++, buf);
+		blocks_read++;
+		send_block(buf, 512, 2);
+	}
+}
@@ -0,0 +1,62 @@
+// Behavioural SD card in native SD bus mode (1-bit or 4-bit), backed by a disk
+// image in memory. Supports what sd_native.c uses: identification, ACMD6 bus
+// width, CMD6 high speed switch, single/multiple block read and write, CMD12,
+// CMD13.
+// The card is clocked by the host: call rise()/fall() on sd_clk edges.
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class SdCard {
+public:
+	SdCard(std::vector<uint8_t> &image) : image(image) {}
+
+	// rising edge: sample what the host drives (1 where released)
+	void rise(bool cmd, uint8_t dat);
+	// falling edge: the card updates its outputs
+	void fall();
+
+	// card outputs, 1 where released
+	bool cmd_out() const { return cmd_line; }
+	uint8_t dat_out() const { return dat_line; }
+
+	bool high_speed = false;
+	int cmd_crc_errors = 0;
+	int data_crc_errors = 0;
+	uint64_t blocks_read = 0, blocks_written = 0;
+
+private:
+	enum State { IDLE, READY, IDENT, STBY, TRAN, DATA, RCV };
+
+	void command(int idx, uint32_t arg);
+	void respond(int idx, uint32_t payload, int busy = 0);
+	void respond_bits(const std::vector<bool> &bits, int busy = 0);
+	void send_block(const uint8_t *data, int len, int gap);
+	void read_sector(uint32_t sector, uint8_t *buf);
+	void write_sector(uint32_t sector, const uint8_t *buf);
+	uint32_t status() const;
+
+	std::vector<uint8_t> &image;
+	State state = IDLE;
+	bool app = false, wide = false, multi = false;
+	int acmd41_count = 0;
+	uint16_t rca = 0x1234;
+	uint32_t block = 0;				// next block to read or write
+
+	// command receiver
+	bool cmd_rx = false;
+	int cmd_n = 0;
+	uint64_t cmd_bits = 0;
+
+	// block receiver: -1 waiting for start bit, then bit clocks
+	int rcv_n = -1;
+	uint8_t rcv_buf[512];
+	uint16_t rcv_crc[4], rcv_crc_in[4];
+
+	// outputs, one entry per clock
+	std::deque<bool> cmd_q;
+	std::deque<uint8_t> dat_q;
+	bool cmd_line = 1;
+	uint8_t dat_line = 0xf;
+};
@@ -0,0 +1,340 @@
+// Native mode SD host harness (sdhost.v) with a behavioural SD card (sd_card.cpp).
+//
+// Drives the sdhost registers like firmware/sd_native.c does: card
+// identification, 4-bit bus, high speed switch, then random single and
+// multi-block reads checked against the image, and stream reads (ROM loading)
+// checked on stream_do. With -w, also writes random blocks and reads them back.
+// The image file itself is never modified.
+// Reports SD throughput at the iosys clock and simulation speed.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#include "Vsdhost.h"
+#include "verilated.h"
+#include "sd_card.h"
+
+using namespace std;
+
+const double FREQ = 21.5e6;				// iosys clock
+
+// CMD register
+const uint32_t RESP_R1 = 1 << 6, RESP_R3 = 2 << 6, RESP_R2 = 3 << 6;
+const uint32_t BUSY = 1 << 8, READ = 1 << 9, WRITE = 1 << 10, DATA_ONLY = 1 << 11, INIT_CLOCKS = 1 << 12,
+			   STREAM = 1 << 13;
+// status
+const uint32_t ST_BUSY = 1, ST_ERRORS = 0x1e;
+// CTRL register
+const uint32_t CTRL_WIDE = 1 << 8, CTRL_EN = 1 << 9;
+static uint32_t blklen(int n) { return (n - 1) << 16; }
+
+Vsdhost *top = new Vsdhost;
+SdCard *card;
+uint64_t cycles;
+bool prev_sd_clk;
+vector<uint8_t> stream_out;			// bytes from stream_do
+
+void usage()
+{
+	printf("Usage: sd [options] <image>\n");
+	printf("  -d N     SD clock divider after init (default 1, clk/2)\n");
+	printf("  -1       stay on the 1-bit bus\n");
+	printf("  -n N     number of random reads (default 200)\n");
+	printf("  -w       also test writes\n");
+	printf("  -s N     random seed\n");
+}
+
+static void tick()
+{
+	top->clk = 1;
+	top->eval();
+	top->clk = 0;
+	top->eval();
+	cycles++;
+	if (top->stream_do_valid)
+		stream_out.push_back(top->stream_do);
+
+	bool host_cmd = top->sd_cmd_oe ? top->sd_cmd_o : 1;
+	uint8_t host_dat = top->sd_dat_oe ? top->sd_dat_o : 0xf;
+	if (top->sd_clk && !prev_sd_clk)
+		card->rise(host_cmd, host_dat);
+	if (!top->sd_clk && prev_sd_clk)
+		card->fall();
+	prev_sd_clk = top->sd_clk;
+	top->sd_cmd_i = host_cmd & card->cmd_out();
+	top->sd_dat_i = host_dat & card->dat_out();
+}
+
+enum Reg { CMD, ARG, CTRL, DATA, STREAM_LEN };
+
+static void reg_write(Reg r, uint32_t v)
+{
+	top->reg_di = v;
+	top->reg_cmd_we = r == CMD;
+	top->reg_arg_we = r == ARG;
+	top->reg_ctrl_we = r == CTRL;
+	top->reg_data_we = r == DATA;
+	top->reg_stream_we = r == STREAM_LEN;
+	tick();
+	top->reg_cmd_we = top->reg_arg_we = top->reg_ctrl_we = top->reg_data_we = top->reg_stream_we = 0;
+	tick();
+}
+
+static uint32_t data_read()
+{
+	uint32_t v = top->reg_data_do;
+	top->reg_data_re = 1;
+	tick();
+	top->reg_data_re = 0;
+	tick();
+	return v;
+}
+
+// same as sdn_cmd() in sd_native.c, returns the error bits
+static uint32_t sd_cmd(uint32_t cmd, uint32_t arg)
+{
+	reg_write(ARG, arg);
+	reg_write(CMD, cmd);
+	while (top->reg_status_do & ST_BUSY)
+		tick();
+	return top->reg_status_do & ST_ERRORS;
+}
+
+static uint32_t rca;
+
+static uint32_t sd_acmd(uint32_t cmd, uint32_t arg)
+{
+	uint32_t r = sd_cmd(55 | RESP_R1, rca);
+	return r ? r : sd_cmd(cmd, arg);
+}
+
+bool sd_init(int div, bool wide)
+{
+	reg_write(CTRL, CTRL_EN | blklen(512) | 27);
+	sd_cmd(INIT_CLOCKS, 0);
+	sd_cmd(0, 0);
+	if (sd_cmd(8 | RESP_R1, 0x1aa) || (top->reg_resp_do & 0xfff) != 0x1aa) {
+		printf("CMD8 failed\n");
+		return false;
+	}
+	uint32_t ocr = 0;
+	for (int i = 0; i < 10 && !(ocr & 0x80000000); i++)
+		if (sd_acmd(41 | RESP_R3, 0x40ff8000) == 0)
+			ocr = top->reg_resp_do;
+	if (!(ocr & 0x80000000)) {
+		printf("ACMD41 failed\n");
+		return false;
+	}
+	if (sd_cmd(2 | RESP_R2, 0) || sd_cmd(3 | RESP_R1, 0)) {
+		printf("CMD2/CMD3 failed\n");
+		return false;
+	}
+	rca = top->reg_resp_do & 0xffff0000;
+	if (sd_cmd(7 | RESP_R1 | BUSY, rca)) {
+		printf("CMD7 failed\n");
+		return false;
+	}
+	uint32_t ctrl = CTRL_EN;
+	if (wide) {
+		if (sd_acmd(6 | RESP_R1, 2)) {
+			printf("ACMD6 failed\n");
+			return false;
+		}
+		ctrl |= CTRL_WIDE;
+	}
+	reg_write(CTRL, ctrl | blklen(64) | 27);
+	uint32_t r = sd_cmd(6 | RESP_R1 | READ, 0x80fffff1);
+	uint32_t st[16];
+	for (int i = 0; i < 16; i++) st[i] = data_read();
+	if (r || (st[4] & 0xf) != 1 || !card->high_speed) {
+		printf("CMD6 high speed switch failed: %x\n", r);
+		return false;
+	}
+	reg_write(CTRL, ctrl | blklen(512) | div);
+	return true;
+}
+
+bool read_sectors(uint32_t sector, uint8_t *buf, int count)
+{
+	bool multi = count > 1;
+	uint32_t r = sd_cmd((multi ? 18 : 17) | RESP_R1 | READ, sector);
+	while (!r) {
+		for (int i = 0; i < 512; i += 4) {
+			uint32_t w = data_read();
+			memcpy(buf + i, &w, 4);
+		}
+		buf += 512;
+		if (--count == 0) break;
+		r = sd_cmd(DATA_ONLY | READ, 0);
+	}
+	if (multi)
+		sd_cmd(12 | RESP_R1 | BUSY, 0);
+	return r == 0;
+}
+
+// like sdn_stream(): one CMD18, the host reads on until len bytes went out
+bool stream_sectors(uint32_t sector, uint32_t len)
+{
+	stream_out.clear();
+	reg_write(STREAM_LEN, len);
+	uint32_t r = sd_cmd(18 | RESP_R1 | READ | STREAM, sector);
+	sd_cmd(12 | RESP_R1 | BUSY, 0);
+	return r == 0 && top->reg_stream_do == 0 && stream_out.size() == len;
+}
+
+bool write_sectors(uint32_t sector, const uint8_t *buf, int count)
+{
+	bool multi = count > 1;
+	if (multi)
+		sd_acmd(23 | RESP_R1, count);
+	for (int i = 0; i < 512; i += 4) {
+		uint32_t w;
+		memcpy(&w, buf + i, 4);
+		reg_write(DATA, w);
+	}
+	uint32_t r = sd_cmd((multi ? 25 : 24) | RESP_R1 | WRITE, sector);
+	while (!r && --count) {
+		buf += 512;
+		for (int i = 0; i < 512; i += 4) {
+			uint32_t w;
+			memcpy(&w, buf + i, 4);
+			reg_write(DATA, w);
+		}
+		r = sd_cmd(DATA_ONLY | WRITE, 0);
+	}
+	if (multi)
+		sd_cmd(12 | RESP_R1 | BUSY, 0);
+	return r == 0;
+}
+
+int main(int argc, char **argv, char **env)
+{
+	Verilated::commandArgs(argc, argv);
+	const char *image_file = NULL;
+	int div = 1, reads = 200;
+	bool wide = true, write_test = false;
+	unsigned seed = 1;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+			div = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-1") == 0)
+			wide = false;
+		else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			reads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-w") == 0)
+			write_test = true;
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+			seed = atoi(argv[++i]);
+		else if (argv[i][0] == '-') {
+			printf("Unrecognized option: %s\n", argv[i]);
+			usage();
+			exit(1);
+		} else
+			image_file = argv[i];
+	}
+	if (!image_file) {
+		usage();
+		exit(1);
+	}
+
+	FILE *f = fopen(image_file, "rb");
+	if (!f) {
+		printf("Cannot open file %s\n", image_file);
+		exit(1);
+	}
+	vector<uint8_t> image;
+	uint8_t buf[65536];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		image.insert(image.end(), buf, buf + n);
+	fclose(f);
+	uint32_t sectors = image.size() / 512;
+	if (sectors < 16) {
+		printf("Image is too small\n");
+		exit(1);
+	}
+	printf("Image %s: %u sectors\n", image_file, sectors);
+	const vector<uint8_t> orig = image;
+	card = new SdCard(image);
+	srand(seed);
+
+	top->resetn = 0;
+	for (int i = 0; i < 8; i++) tick();
+	top->resetn = 1;
+
+	bool pass = sd_init(div, wide);
+	printf("Card init %s after %llu cycles\n", pass ? "done" : "FAILED", (unsigned long long)cycles);
+
+	auto start = chrono::steady_clock::now();
+	uint64_t start_cycles = cycles, bytes = 0;
+	int errors = 0;
+	vector<uint8_t> rbuf(8 * 512);
+	for (int i = 0; pass && i < reads; i++) {
+		int count = rand() % 8 + 1;
+		uint32_t sector = rand() % (sectors - count + 1);
+		if (!read_sectors(sector, rbuf.data(), count)) {
+			printf("Read error at sector %u, count %d: status %x\n", sector, count, top->reg_status_do);
+			errors++;
+		} else if (memcmp(rbuf.data(), &orig[sector * 512], count * 512) != 0) {
+			printf("Data mismatch at sector %u, count %d\n", sector, count);
+			errors++;
+		}
+		bytes += count * 512;
+	}
+	uint64_t read_cycles = cycles - start_cycles;
+
+	start_cycles = cycles;
+	uint64_t stream_bytes = 0;
+	for (int i = 0; pass && i < reads / 10 + 1; i++) {
+		uint32_t len = (rand() % (32 * 512) + 4) & ~3;
+		uint32_t sector = rand() % (sectors - (len + 511) / 512 + 1);
+		if (!stream_sectors(sector, len)) {
+			printf("Stream error at sector %u, %u bytes: status %x, %zu bytes out\n", sector, len,
+				   top->reg_status_do, stream_out.size());
+			errors++;
+		} else if (memcmp(stream_out.data(), &orig[sector * 512], len) != 0) {
+			printf("Stream mismatch at sector %u, %u bytes\n", sector, len);
+			errors++;
+		}
+		stream_bytes += len;
+	}
+	uint64_t stream_cycles = cycles - start_cycles;
+
+	if (pass && write_test) {
+		vector<uint8_t> wbuf(8 * 512);
+		for (int i = 0; i < 20; i++) {
+			int count = rand() % 8 + 1;
+			uint32_t sector = rand() % (sectors - count + 1);
+			for (auto &b : wbuf) b = rand();
+			if (!write_sectors(sector, wbuf.data(), count) || !read_sectors(sector, rbuf.data(), count) ||
+				memcmp(rbuf.data(), wbuf.data(), count * 512) != 0 ||
+				memcmp(&image[sector * 512], wbuf.data(), count * 512) != 0) {
+				printf("Write test failed at sector %u, count %d: status %x\n", sector, count, top->reg_status_do);
+				errors++;
+			}
+		}
+	}
+	double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	printf("Blocks read: %llu, written: %llu, CRC errors: command %d, data %d\n",
+		   (unsigned long long)card->blocks_read, (unsigned long long)card->blocks_written,
+		   card->cmd_crc_errors, card->data_crc_errors);
+	if (read_cycles)
+		printf("Read throughput: %.0f KB/s at %.1fMhz, SD clock %.2fMhz\n",
+			   bytes / (read_cycles / FREQ) / 1024, FREQ / 1e6, FREQ / 2 / div / 1e6);
+	if (stream_cycles)
+		printf("Stream throughput: %.0f KB/s\n", stream_bytes / (stream_cycles / FREQ) / 1024);
+	printf("Simulation: %llu cycles, %.2fs, %.2f Mcycles/s\n",
+		   (unsigned long long)cycles, secs, cycles / secs / 1e6);
+	if (errors || card->cmd_crc_errors || card->data_crc_errors)
+		pass = false;
+	printf("%s\n", pass ? "PASS" : "FAIL");
+
+	top->final();
+	delete top;
+	return pass ? 0 : 1;
+}
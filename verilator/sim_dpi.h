@@ -0,0 +1,43 @@
+// Access to mdtang_top state through the DPI functions exported in mdtang_top.sv.
+// Unlike Vmdtang_top_mdtang_top members, these also work in the SIM_NO_PUBLIC build.
+#pragma once
+
+#include <cstdint>
+#include "svdpi.h"
+#include "Vmdtang_top__Dpi.h"
+
+// call once after the model is constructed
+static inline void md_dpi_init() {
+	svSetScope(svGetScopeFromName("TOP.mdtang_top"));
+}
+
+struct MdVideo {
+	uint8_t red, green, blue;		// 4 bits each
+	bool ce_pix, hsync, hblank, vblank;
+	uint8_t resolution;				// {V30, H40}
+};
+
+static inline MdVideo md_get_video() {
+	uint32_t v = md_video();
+	MdVideo r;
+	r.blue = v & 0xf;
+	r.green = (v >> 4) & 0xf;
+	r.red = (v >> 8) & 0xf;
+	r.ce_pix = (v >> 12) & 1;
+	r.hsync = (v >> 13) & 1;
+	r.hblank = (v >> 14) & 1;
+	r.vblank = (v >> 15) & 1;
+	r.resolution = (v >> 16) & 3;
+	return r;
+}
+
+static inline bool md_get_on() { return md_status() & 1; }
+static inline bool md_get_reset() { return (md_status() >> 1) & 1; }
+static inline uint16_t md_get_audio_left() { return (uint32_t)md_audio() >> 16; }
+static inline uint16_t md_get_audio_right() { return md_audio() & 0xffff; }
+
+// CRAM entry in the Genesis 0000BBB0GGG0RRR0 format
+static inline uint16_t md_get_cram(int i) {
+	uint32_t c = md_cram_read(i);
+	return ((c >> 6) & 7) << 9 | ((c >> 3) & 7) << 5 | (c & 7) << 1;
+}
@@ -8,7 +8,9 @@
 #include <SDL.h>
 
 #include "Vmdtang_top.h"
-#include "Vmdtang_top_mdtang_top.h"
+#include "sim_dpi.h"
+#include "recorder.h"
+#include "frame_shm.h"
 
 #include "verilated.h"
 #include <verilated_fst_c.h>
@@ -26,15 +28,49 @@ int resolution_y = V_RES;
 int pixel_x, pixel_y;
 bool hsync_seen;
 
-typedef struct Pixel
-{			   // for SDL texture
-	uint8_t a; // transparency
-	uint8_t b; // blue
-	uint8_t g; // green
-	uint8_t r; // red
-} Pixel;
+// Pixels are kept as 12-bit RGB444 (R in bits 11-8) and expanded to the
+// RGBA8888 streaming texture through rgb_lut, only for lines that changed.
+uint16_t screenbuffer[H_RES * V_RES];
+bool line_dirty[V_RES];
+uint32_t rgb_lut[4096];
 
-Pixel screenbuffer[H_RES * V_RES];
+void init_rgb_lut()
+{
+	for (int c = 0; c < 4096; c++) {
+		uint32_t r = (c >> 8) * 0x11, g = ((c >> 4) & 0xf) * 0x11, b = (c & 0xf) * 0x11;
+		rgb_lut[c] = r << 24 | g << 16 | b << 8 | 0xff;		// SDL_PIXELFORMAT_RGBA8888
+	}
+}
+
+// plain table lookup, simple enough for the compiler to vectorize (gather)
+static void expand_line(uint32_t *__restrict dst, const uint16_t *__restrict src)
+{
+	for (int x = 0; x < H_RES; x++)
+		dst[x] = rgb_lut[src[x] & 0xfff];
+}
+
+// copy dirty lines to the texture. The locked area is write-only, so we
+// lock the span from first to last dirty line and fill all of it.
+void update_texture(SDL_Texture *texture)
+{
+	int y0 = 0, y1 = V_RES - 1;
+	while (y0 < V_RES && !line_dirty[y0]) y0++;
+	if (y0 == V_RES) return;
+	while (!line_dirty[y1]) y1--;
+
+	SDL_Rect rect = {0, y0, H_RES, y1 - y0 + 1};
+	void *pixels;
+	int pitch;
+	if (SDL_LockTexture(texture, &rect, &pixels, &pitch) < 0) {
+		printf("SDL_LockTexture failed: %s\n", SDL_GetError());
+		return;
+	}
+	for (int y = y0; y <= y1; y++) {
+		expand_line((uint32_t *)((uint8_t *)pixels + (y - y0) * pitch), &screenbuffer[y * H_RES]);
+		line_dirty[y] = false;
+	}
+	SDL_UnlockTexture(texture);
+}
 
 long long max_sim_time = 0LL;
 
@@ -43,6 +79,8 @@ bool trace_loading;				// -tl option
 long long start_trace_time;		// -tt option
 int start_trace_frame;			// -tf option
 bool showFrameCount = true;
+Recorder recorder;				// --record option
+FrameShmWriter frame_shm;		// --shm option
 
 void usage()
 {
@@ -53,19 +91,21 @@ void usage()
 	printf("  -tl    start tracing from game loading (i.e. before md is turned on)\n");
 	printf("  -s T   stop simulation at time T\n");
 	printf("  -f     print flash related memory accesses\n");
+	printf("  --record out.y4m   record video (and out.wav) in the background\n");
+	printf("  --record \"|cmd\"   pipe raw rgb24 %dx%d frames to cmd, audio to record.wav\n", H_RES, V_RES);
+	printf("  --shm NAME         publish frames to POSIX shared memory NAME (e.g. /mdtang), see frame_shm.h\n");
 }
 
 void help() {
 	printf("ROM loaded. Use these keys in the simulation window for controls:\n");
 	printf("SPC: Start/stop simulation.      ESC: Quit.     T: toggle tracing on/off\n");
 	printf("Arrow keys: D-pad, A: A button, S: B button, D: C button, Q: X button, W: Y button, E: Z Select, Z: Start, X: Mode\n");
-	// printf("V: dump VRAM.\n");
+	printf("V: dump VRAM/CRAM/VSRAM/VDP registers to vdp.bin\n");
 	// printf("I: show additional info like frame count.\n");
 }
 
 VerilatedFstC *m_trace;
 Vmdtang_top *top = new Vmdtang_top;
-Vmdtang_top_mdtang_top *md = top->mdtang_top;
 uint64_t sim_time;
 uint8_t clkcnt;
 int hblank_r, ce_pix_r;
@@ -75,6 +115,7 @@ vector<string> tokenize(string s);
 long long parse_num(string s);
 void trace_on();
 void trace_off();
+void dump_vdp(const char *fname);
 
 static void loading_step()
 {
@@ -92,7 +133,7 @@ static void loading_step()
 // size: number of bytes
 void md_load(uint8_t *rom, int size)
 {
-	while (md->reset || !top->clk_sys)
+	while (md_get_reset() || !top->clk_sys)
 		loading_step();
 
 	top->loading = 1;
@@ -144,7 +185,7 @@ void load_rom(char *filename) {
 int main(int argc, char **argv, char **env)
 {
 	Verilated::commandArgs(argc, argv);
-	Vmdtang_top_mdtang_top *md = top->mdtang_top;
+	md_dpi_init();
 	bool frame_updated = false;
 	uint64_t start_ticks = SDL_GetPerformanceCounter();
 	int frame_count = 0;
@@ -188,6 +229,14 @@ int main(int argc, char **argv, char **env)
 			trace_toggle = true;
 			printf("Include loading in tracing\n");
 		}
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			if (!recorder.open(argv[++i], H_RES, V_RES))
+				exit(1);
+		}
+		else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+			if (!frame_shm.open(argv[++i]))
+				exit(1);
+		}
 		else if (argv[i][0] == '-') {
 			printf("Unrecognized option: %s\n", argv[i]);
 			usage();
@@ -235,14 +284,16 @@ int main(int argc, char **argv, char **env)
 	}
 
 	sdl_texture = SDL_CreateTexture(sdl_renderer, SDL_PIXELFORMAT_RGBA8888,
-									SDL_TEXTUREACCESS_TARGET, H_RES, V_RES);
+									SDL_TEXTUREACCESS_STREAMING, H_RES, V_RES);
 	if (!sdl_texture)
 	{
 		printf("Texture creation failed: %s\n", SDL_GetError());
 		return 1;
 	}
 
+#ifndef AUDIO_STUB
 	FILE *f = fopen("md.aud", "w");
+#endif
 	long long samples = 0;
 	bool sample_valid = false;
 
@@ -250,7 +301,9 @@ int main(int argc, char **argv, char **env)
 	bool done = false;
 	uint64_t cnt = 0;
 
-	SDL_UpdateTexture(sdl_texture, NULL, screenbuffer, H_RES * sizeof(Pixel));
+	init_rgb_lut();
+	memset(line_dirty, 1, sizeof(line_dirty));		// texture starts out undefined
+	update_texture(sdl_texture);
 	SDL_RenderClear(sdl_renderer);
 	SDL_RenderCopy(sdl_renderer, sdl_texture, NULL, NULL);
 	SDL_RenderPresent(sdl_renderer);
@@ -275,6 +328,7 @@ int main(int argc, char **argv, char **env)
 			if (top->clk_sys) top->clk_z80 = !top->clk_z80;
 			top->clk_sys = !top->clk_sys;
 			top->eval();
+			MdVideo v = md_get_video();
 
 			if (	trace_toggle ||
 					start_trace_time != 0 && sim_time == start_trace_time ||
@@ -285,15 +339,17 @@ int main(int argc, char **argv, char **env)
 				m_trace->dump(sim_time);
 			}
 
+#ifndef AUDIO_STUB
 			// collect audio samples @ 48Khz
-			if (sim_time % (53693175 * 2 / 48000) == 0 && md->md_on) {
+			if (sim_time % (53693175 * 2 / 48000) == 0 && md_get_on()) {
 				uint16_t ar, al;
-				ar = md->audio_right;
-				al = md->audio_left;
+				ar = md_get_audio_right();
+				al = md_get_audio_left();
 				if (al != 0 || ar != 0)
 					sample_valid = true;
 				fwrite(&al, sizeof(al), 1, f);
 				fwrite(&ar, sizeof(ar), 1, f);
+				recorder.add_audio(al, ar);
 				samples++;
 				if (samples % 1000 == 0 && sample_valid)
 				{
@@ -301,17 +357,18 @@ int main(int argc, char **argv, char **env)
 					sample_valid = false;
 				}
 			}
+#endif
 
-			if (md->vblank) {
+			if (v.vblank) {
 				pixel_y = 0;
 				hsync_seen = false;
 			}
-			if (md->hs) {
+			if (v.hsync) {
 				hsync_seen = true;
 			}
 
 			if (hsync_seen) {
-				if (md->hblank) {
+				if (v.hblank) {
 					pixel_x = 0;
 					if (!hblank_r) {
 						pixel_y++;
@@ -320,14 +377,15 @@ int main(int argc, char **argv, char **env)
 					}
 				}
 			}
-			hblank_r = md->hblank;
-
-			if (hsync_seen && md->ce_pix && !ce_pix_r && pixel_x < H_RES && pixel_y < V_RES) {
-				Pixel *p = &screenbuffer[pixel_y * H_RES + pixel_x];
-				p->a = 0xff;
-				p->r = md->red << 4;
-				p->g = md->green << 4;
-				p->b = md->blue << 4;
+			hblank_r = v.hblank;
+
+			if (hsync_seen && v.ce_pix && !ce_pix_r && pixel_x < H_RES && pixel_y < V_RES) {
+				uint16_t *p = &screenbuffer[pixel_y * H_RES + pixel_x];
+				uint16_t c = v.red << 8 | v.green << 4 | v.blue;
+				if (*p != c) {
+					*p = c;
+					line_dirty[pixel_y] = true;
+				}
 				pixel_x++;
 
 				if (sim_time % 10000000 == 0) {
@@ -335,31 +393,33 @@ int main(int argc, char **argv, char **env)
 					printf("Pixel clock: %fMhz\n", (double)(53593175 * 2) / pix_time / 1000000);
 				}
 				last_pixel_time = sim_time;
-				// if (p->r || p->g || p->b) {
-				// 	printf("Pixel: %d, %d, %d, %d, %d\n", pixel_x, pixel_y, p->r, p->g, p->b);
+				// if (c) {
+				// 	printf("Pixel: %d, %d, %03x\n", pixel_x, pixel_y, c);
 				// }
 			}
-			ce_pix_r = md->ce_pix;
+			ce_pix_r = v.ce_pix;
 
 			// update texture once per frame (in blanking)
-			if (md->vblank) {
+			if (v.vblank) {
 				if (!frame_updated)
 				{
 					// check resolution
-					switch (md->resolution) {
+					switch (v.resolution) {
 						case 0: resolution_x = 256; resolution_y = 224; break;
 						case 1: resolution_x = 320; resolution_y = 224; break;
 						case 2: resolution_x = 256; resolution_y = 240; break;
 						case 3: resolution_x = 320; resolution_y = 240; break;
 					}
-					if (resolution != md->resolution) {
+					if (resolution != v.resolution) {
 						SDL_SetWindowSize(sdl_window, resolution_x * 2, resolution_y * 2);
 						printf("Resolution: %d x %d\n", resolution_x, resolution_y);
-						resolution = md->resolution;
+						resolution = v.resolution;
 					}
 
 					frame_updated = true;
-					SDL_UpdateTexture(sdl_texture, NULL, screenbuffer, H_RES * sizeof(Pixel));
+					update_texture(sdl_texture);
+					recorder.push_frame(screenbuffer);
+					frame_shm.publish(screenbuffer, frame_count, sim_time, v.resolution);
 					SDL_RenderClear(sdl_renderer);
 					const SDL_Rect srcRect = {0, 0, resolution_x, resolution_y};
 					SDL_RenderCopy(sdl_renderer, sdl_texture, &srcRect, NULL);
@@ -409,24 +469,7 @@ int main(int argc, char **argv, char **env)
 					// case SDLK_p:		showSpritesWindow(); break;
 					// case SDLK_m:        showTilemapWindow(); break;
 					case SDLK_t:		trace_toggle = !trace_toggle; break;
-					case SDLK_v: {
-						// FILE *f = fopen("vram.bin", "wb");
-						// if (!f)
-						// {
-						// 	cout << "Cannot open vram.bin for writing" << endl;
-						// 	continue;
-						// }
-						// uint8_t *vram = (uint8_t *)malloc(96 * 1024); // 96KB
-						// for (int i = 0; i < 64 * 1024; i += 4)
-						// 	((uint32_t *)vram)[i / 4] = ivram_lo->mem[i / 4];
-						// for (int i = 0; i < 32 * 1024; i += 4)
-						// 	((uint32_t *)vram)[16384 + i / 4] = ivram_hi->mem[i / 4];
-						// fwrite(vram, 1, 96 * 1024, f);
-						// free(vram);
-						// fclose(f);
-						cout << "VRAM dumping not implemented yet" << endl;
-						break;
-					}
+					case SDLK_v:		dump_vdp("vdp.bin"); break;
 					case SDLK_i:	showFrameCount = !showFrameCount; break;
 					}
 					// FALL THROUGH				
@@ -466,9 +509,13 @@ int main(int argc, char **argv, char **env)
 		}
 	}
 
+#ifndef AUDIO_STUB
 	fclose(f);
 	printf("Audio output to md.aud done.\n");
+#endif
 
+	recorder.close();
+	frame_shm.close();
 	if (m_trace)
 		m_trace->close();
 	delete top;
@@ -556,3 +603,30 @@ void trace_off()
 	}
 }
 
+
+// Dump VDP state: VRAM (64KB), CRAM (64 x 16-bit), VSRAM (40 x 16-bit), then 32 registers.
+// Words are big-endian, as seen by the 68K.
+void dump_vdp(const char *fname)
+{
+	FILE *f = fopen(fname, "wb");
+	if (!f) {
+		printf("Cannot open %s for writing\n", fname);
+		return;
+	}
+	for (int i = 0; i < 32768; i++) {
+		uint16_t w = md_vram_read(i);
+		fputc(w >> 8, f); fputc(w & 0xff, f);
+	}
+	for (int i = 0; i < 64; i++) {
+		uint16_t w = md_get_cram(i);
+		fputc(w >> 8, f); fputc(w & 0xff, f);
+	}
+	for (int i = 0; i < 40; i++) {
+		uint16_t w = md_vsram_read(i);
+		fputc(w >> 8, f); fputc(w & 0xff, f);
+	}
+	for (int i = 0; i < 32; i++)
+		fputc(md_vdp_reg(i), f);
+	fclose(f);
+	printf("VDP state dumped to %s\n", fname);
+}
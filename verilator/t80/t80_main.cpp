@@ -0,0 +1,185 @@
+// T80 harness with 64KB of RAM and a minimal CP/M environment, for running
+// CP/M test programs like ZEXDOC/ZEXALL directly on the Z80 core (T80s).
+//
+// The .com file is loaded at 0x100 and called with the stack below the BDOS
+// stub. BDOS calls 2 (console output) and 9 (print string) are served by a
+// small Z80 stub that writes characters to CONOUT_PORT. The run ends when the
+// program jumps or returns to warm boot (0x0000). The test fails if the output
+// contains "ERROR" (as ZEXDOC/ZEXALL print), or the cycle limit is hit first.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <string>
+
+#include "VT80s.h"
+#include "verilated.h"
+
+using namespace std;
+
+const uint8_t CONOUT_PORT = 0x01;
+const uint16_t BDOS_STUB = 0xfe00;
+const uint16_t START = 0xff00;
+
+VT80s *top = new VT80s;
+uint8_t mem[65536];
+uint64_t cycles;
+
+// 0x0000: jump to START after reset, later calls here are warm boots
+const uint8_t page0[] = {
+	0xc3, START & 0xff, START >> 8,				// jp START
+	0x00, 0x00,
+	0xc3, BDOS_STUB & 0xff, BDOS_STUB >> 8,		// 0x0005: jp BDOS_STUB, 0x0006 is also top of TPA
+};
+
+// START: call the program with 0x0000 as return address
+const uint8_t start_code[] = {
+	0x31, BDOS_STUB & 0xff, BDOS_STUB >> 8,		// ld sp,BDOS_STUB
+	0x21, 0x00, 0x00,		// ld hl,0
+	0xe5,					// push hl
+	0xc3, 0x00, 0x01,		// jp 0x100
+};
+
+// BDOS_STUB: functions 2 and 9, everything else returns
+const uint8_t bdos[] = {
+	0x79,					// ld a,c
+	0xfe, 0x02,				// cp 2
+	0x28, 0x05,				// jr z,conout
+	0xfe, 0x09,				// cp 9
+	0x28, 0x05,				// jr z,prstr
+	0xc9,					// ret
+	0x7b,					// conout: ld a,e
+	0xd3, CONOUT_PORT,		// out (CONOUT_PORT),a
+	0xc9,					// ret
+	0x1a,					// prstr: ld a,(de)
+	0xfe, '$',				// cp '$'
+	0xc8,					// ret z
+	0xd3, CONOUT_PORT,		// out (CONOUT_PORT),a
+	0x13,					// inc de
+	0x18, 0xf7,				// jr prstr
+};
+
+void usage()
+{
+	printf("Usage: t80 [options] <program.com>\n");
+	printf("  -c N     stop after N cycles (default 0, no limit)\n");
+	printf("  -q       do not echo program output\n");
+}
+
+static void tick()
+{
+	top->CLK = 1;
+	top->eval();
+	top->CLK = 0;
+	top->eval();
+	cycles++;
+}
+
+int main(int argc, char **argv, char **env)
+{
+	Verilated::commandArgs(argc, argv);
+	const char *com_file = NULL;
+	uint64_t max_cycles = 0;
+	bool quiet = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+			max_cycles = strtoull(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-q") == 0)
+			quiet = true;
+		else if (argv[i][0] == '-') {
+			printf("Unrecognized option: %s\n", argv[i]);
+			usage();
+			exit(1);
+		} else
+			com_file = argv[i];
+	}
+	if (!com_file) {
+		usage();
+		exit(1);
+	}
+
+	FILE *f = fopen(com_file, "rb");
+	if (!f) {
+		printf("Cannot open file %s\n", com_file);
+		exit(1);
+	}
+	size_t size = fread(&mem[0x100], 1, BDOS_STUB - 0x100, f);
+	fclose(f);
+	printf("Loaded %zu bytes at 0100\n", size);
+	memcpy(mem, page0, sizeof(page0));
+	memcpy(&mem[BDOS_STUB], bdos, sizeof(bdos));
+	memcpy(&mem[START], start_code, sizeof(start_code));
+
+	top->CEN = 1;
+	top->WAIT_n = 1;
+	top->INT_n = 1;
+	top->NMI_n = 1;
+	top->BUSRQ_n = 1;
+	top->OUT0 = 0;
+	top->RESET_n = 0;
+	for (int i = 0; i < 8; i++) tick();
+	top->RESET_n = 1;
+	cycles = 0;
+
+	auto start = chrono::steady_clock::now();
+	string output;
+	uint64_t instrs = 0;
+	bool prev_m1 = true, prev_io_wr = false, prefix = false, started = false, done = false;
+	while (!done && (!max_cycles || cycles < max_cycles)) {
+		tick();
+
+		uint16_t a = top->A;
+		// count instructions at opcode fetch, prefixes belong to the following opcode
+		if (prev_m1 && !top->M1_n) {
+			uint8_t op = mem[a];
+			if (!prefix) instrs++;
+			prefix = op == 0xcb || op == 0xdd || op == 0xed || op == 0xfd;
+			if (a == 0x0000 && started)
+				done = true;
+			if (a == 0x100)
+				started = true;
+		}
+		prev_m1 = top->M1_n;
+
+		if (!top->MREQ_n && !top->WR_n)
+			mem[a] = top->DO;
+
+		bool io_wr = !top->IORQ_n && !top->WR_n;
+		if (io_wr && !prev_io_wr) {
+			uint8_t port = a & 0xff;
+			if (port == CONOUT_PORT) {
+				output += (char)top->DO;
+				if (!quiet) {
+					putchar(top->DO);
+					fflush(stdout);
+				}
+			}
+		}
+		prev_io_wr = io_wr;
+
+		top->DI = top->IORQ_n ? mem[top->A] : 0xff;
+	}
+	double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	printf("\nInstructions: %llu, cycles: %llu, time: %.2fs\n",
+		   (unsigned long long)instrs, (unsigned long long)cycles, secs);
+	printf("Throughput: %.0f instructions/s, %.2f Mcycles/s (%.2fx a 3.58Mhz Z80)\n",
+		   instrs / secs, cycles / secs / 1e6, cycles / secs / 3579545);
+
+	bool pass = true;
+	if (!done) {
+		printf("Program did not return to CP/M within %llu cycles\n", (unsigned long long)max_cycles);
+		pass = false;
+	}
+	if (output.find("ERROR") != string::npos) {
+		printf("Program reported errors\n");
+		pass = false;
+	}
+	printf("%s\n", pass ? "PASS" : "FAIL");
+
+	top->final();
+	delete top;
+	return pass ? 0 : 1;
+}
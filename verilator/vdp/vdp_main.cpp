@@ -0,0 +1,202 @@
+// VDP rendering harness (vdp_top.sv).
+//
+// Loads a VDP state dump into the VDP through its data and control ports,
+// like the 68K would, then renders frames from it. Prints a hash per frame and
+// frames/s. The dump is the vdp.bin written by the main simulator ('V' key):
+//   VRAM     65536 bytes
+//   CRAM     64 words, 0000BBB0GGG0RRR0
+//   VSRAM    40 words
+//   REG      32 bytes
+// Words are big-endian.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#include "Vvdp_top.h"
+#include "verilated.h"
+
+using namespace std;
+
+const int DUMP_SIZE = 65536 + 64 * 2 + 40 * 2 + 32;
+
+Vvdp_top *top = new Vvdp_top;
+uint64_t cycles;
+
+void usage()
+{
+	printf("Usage: vdp [options] <vdp.bin>\n");
+	printf("  -f N     render N frames (default 10)\n");
+	printf("  -p       PAL timing\n");
+	printf("  -o F     save the last frame to F (.ppm)\n");
+	printf("  -q       only print the final report\n");
+}
+
+static void tick()
+{
+	top->clk = 1;
+	top->eval();
+	top->clk = 0;
+	top->eval();
+	cycles++;
+}
+
+// 68K word write to a VDP port: hold SEL until DTACK
+static void port_write(int addr, uint16_t data)
+{
+	top->sel = 1;
+	top->a = addr;
+	top->rnw = 0;
+	top->di = data;
+	do tick(); while (top->dtack_n);
+	top->sel = 0;
+	tick();
+}
+
+static void set_reg(int r, uint8_t v) { port_write(4, 0x8000 | r << 8 | v); }
+
+// code: 1 VRAM write, 3 CRAM write, 5 VSRAM write
+static void set_addr(int code, uint16_t addr)
+{
+	port_write(4, (code & 3) << 14 | (addr & 0x3fff));
+	port_write(4, (code >> 2) << 4 | addr >> 14);
+}
+
+static uint16_t be16(const uint8_t *p) { return p[0] << 8 | p[1]; }
+
+void load_state(const uint8_t *dump)
+{
+	const uint8_t *vram = dump, *cram = dump + 65536, *vsram = cram + 128, *reg = vsram + 80;
+
+	// mode 5, display and DMA off while loading, auto-increment 2
+	set_reg(1, 0x04);
+	set_reg(15, 2);
+
+	set_addr(1, 0);
+	for (int i = 0; i < 65536; i += 2)
+		port_write(0, be16(vram + i));
+	set_addr(3, 0);
+	for (int i = 0; i < 64; i++)
+		port_write(0, be16(cram + i * 2));
+	set_addr(5, 0);
+	for (int i = 0; i < 40; i++)
+		port_write(0, be16(vsram + i * 2));
+
+	// wait for the FIFO to drain before switching the display on
+	for (int i = 0; i < 10000; i++) tick();
+
+	for (int r = 0; r < 24; r++)
+		if (r != 1) set_reg(r, reg[r]);
+	set_reg(1, reg[1]);
+}
+
+int main(int argc, char **argv, char **env)
+{
+	Verilated::commandArgs(argc, argv);
+	const char *dump_file = NULL, *ppm_file = NULL;
+	int max_frames = 10;
+	bool quiet = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+			max_frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-p") == 0)
+			top->pal = 1;
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			ppm_file = argv[++i];
+		else if (strcmp(argv[i], "-q") == 0)
+			quiet = true;
+		else if (argv[i][0] == '-') {
+			printf("Unrecognized option: %s\n", argv[i]);
+			usage();
+			exit(1);
+		} else
+			dump_file = argv[i];
+	}
+	if (!dump_file) {
+		usage();
+		exit(1);
+	}
+
+	vector<uint8_t> dump(DUMP_SIZE);
+	FILE *f = fopen(dump_file, "rb");
+	if (!f) {
+		printf("Cannot open file %s\n", dump_file);
+		exit(1);
+	}
+	if (fread(dump.data(), 1, DUMP_SIZE, f) != DUMP_SIZE) {
+		printf("%s is not a VDP dump (expected %d bytes)\n", dump_file, DUMP_SIZE);
+		exit(1);
+	}
+	fclose(f);
+
+	top->reset = 1;
+	for (int i = 0; i < 16; i++) tick();
+	top->reset = 0;
+	load_state(dump.data());
+	printf("VDP state loaded from %s\n", dump_file);
+
+	// skip to the start of the next frame
+	while (!top->vblank) tick();
+	while (top->vblank) tick();
+	cycles = 0;
+
+	auto start = chrono::steady_clock::now();
+	vector<uint16_t> frame(320 * 240);
+	int frames = 0, x = 0, y = 0, width = 0, height = 0;
+	uint64_t frame_hash = 0xcbf29ce484222325ULL, all_hash = frame_hash;
+	bool prev_hblank = false, prev_vblank = false;
+	while (frames < max_frames) {
+		tick();
+		if (top->ce_pix && !top->hblank && !top->vblank) {
+			uint16_t c = top->red << 8 | top->green << 4 | top->blue;
+			if (x < 320 && y < 240)
+				frame[y * 320 + x] = c;
+			x++;
+			frame_hash = (frame_hash ^ (c & 0xff)) * 0x100000001b3ULL;
+			frame_hash = (frame_hash ^ (c >> 8)) * 0x100000001b3ULL;
+		}
+		if (top->hblank && !prev_hblank && x) {
+			width = x;
+			x = 0;
+			y++;
+		}
+		if (top->vblank && !prev_vblank) {
+			height = y;
+			if (!quiet)
+				printf("Frame %d: %dx%d hash %016llx\n", frames, width, height, (unsigned long long)frame_hash);
+			all_hash = (all_hash ^ frame_hash) * 0x100000001b3ULL;
+			frame_hash = 0xcbf29ce484222325ULL;
+			frames++;
+			y = 0;
+		}
+		prev_hblank = top->hblank;
+		prev_vblank = top->vblank;
+	}
+	double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	if (ppm_file && width && height) {
+		FILE *o = fopen(ppm_file, "wb");
+		if (o) {
+			fprintf(o, "P6\n%d %d\n255\n", width, height);
+			for (int i = 0; i < height; i++)
+				for (int j = 0; j < width; j++) {
+					uint16_t c = frame[i * 320 + j];
+					fputc((c >> 8 & 0xf) * 0x11, o);
+					fputc((c >> 4 & 0xf) * 0x11, o);
+					fputc((c & 0xf) * 0x11, o);
+				}
+			fclose(o);
+			printf("Last frame saved to %s\n", ppm_file);
+		}
+	}
+	printf("Frames: %d, cycles: %llu, time: %.2fs\n", frames, (unsigned long long)cycles, secs);
+	printf("Throughput: %.2f frames/s, %.2f Mcycles/s\n", frames / secs, cycles / secs / 1e6);
+	printf("Hash: %016llx\n", (unsigned long long)all_hash);
+
+	top->final();
+	delete top;
+	return 0;
+}
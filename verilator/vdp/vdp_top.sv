@@ -0,0 +1,110 @@
+// VDP-only harness: vdp with its VRAM wired up as in system.sv. The 68K side
+// of the VDP (SEL/A/RNW/DI/DO/DTACK_N) is driven by vdp_main.cpp, which loads
+// VRAM, CRAM, VSRAM and registers through the data/control ports.
+module vdp_top (
+    input clk,                      // 53.69Mhz MCLK
+    input reset,
+
+    input pal,
+
+    // 68K bus to the VDP ports (C00000-C0001F)
+    input sel,
+    input [4:0] a,
+    input rnw,
+    input [15:0] di,
+    output [15:0] dout,
+    output dtack_n,
+
+    output ce_pix,
+    output hblank,
+    output vblank,
+    output [1:0] resolution,
+    output [3:0] red,
+    output [3:0] green,
+    output [3:0] blue
+);
+
+wire        vram_req;
+wire        vram_we;
+wire        vram_u_n;
+wire        vram_l_n;
+wire        vram_we_u = vram_we & ~vram_u_n;
+wire        vram_we_l = vram_we & ~vram_l_n;
+wire [15:1] vram_a;
+wire [15:0] vram_d;
+wire [15:0] vram_q1, vram_q2;
+
+wire        vram32_req;
+wire [15:1] vram32_a;
+wire [31:0] vram32_q;
+
+reg vram_ack;
+always @(posedge clk) vram_ack <= vram_req;
+
+reg vram32_ack;
+always @(posedge clk) vram32_ack <= vram32_req;
+
+dpram #(14) vram_l1 (
+    .clock(clk),
+    .address_a(vram_a[15:2]), .data_a(vram_d[7:0]), .q_a(vram_q1[7:0]),
+    .wren_a(vram_we_l & (vram_ack ^ vram_req) & ~vram_a[1]),
+    .address_b(vram32_a[15:2]), .data_b(8'd0), .wren_b(1'b0), .q_b(vram32_q[7:0])
+);
+
+dpram #(14) vram_u1 (
+    .clock(clk),
+    .address_a(vram_a[15:2]), .data_a(vram_d[15:8]), .q_a(vram_q1[15:8]),
+    .wren_a(vram_we_u & (vram_ack ^ vram_req) & ~vram_a[1]),
+    .address_b(vram32_a[15:2]), .data_b(8'd0), .wren_b(1'b0), .q_b(vram32_q[15:8])
+);
+
+dpram #(14) vram_l2 (
+    .clock(clk),
+    .address_a(vram_a[15:2]), .data_a(vram_d[7:0]), .q_a(vram_q2[7:0]),
+    .wren_a(vram_we_l & (vram_ack ^ vram_req) & vram_a[1]),
+    .address_b(vram32_a[15:2]), .data_b(8'd0), .wren_b(1'b0), .q_b(vram32_q[23:16])
+);
+
+dpram #(14) vram_u2 (
+    .clock(clk),
+    .address_a(vram_a[15:2]), .data_a(vram_d[15:8]), .q_a(vram_q2[15:8]),
+    .wren_a(vram_we_u & (vram_ack ^ vram_req) & vram_a[1]),
+    .address_b(vram32_a[15:2]), .data_b(8'd0), .wren_b(1'b0), .q_b(vram32_q[31:24])
+);
+
+vdp vdp (
+    .RST_N(~reset),
+    .CLK(clk),
+    .CE(1'b1),
+
+    .SEL(sel), .A(a), .RNW(rnw), .DI(di), .DO(dout), .DTACK_N(dtack_n),
+
+    .vram_req(vram_req), .vram_ack(vram_ack), .vram_we(vram_we),
+    .vram_u_n(vram_u_n), .vram_l_n(vram_l_n), .vram_a(vram_a), .vram_d(vram_d),
+    .vram_q(vram_a[1] ? vram_q2 : vram_q1),
+
+    .vram32_req(vram32_req), .vram32_ack(vram32_ack), .vram32_a(vram32_a), .vram32_q(vram32_q),
+
+    // no CPU: interrupts are not acknowledged and 68K bus DMA is never granted
+    .EXINT(), .HL(1'b0), .HINT(), .VINT_TG68(), .VINT_T80(), .INTACK(1'b0),
+    .BR_N(), .BG_N(1'b1), .BGACK_N(),
+    .VBUS_ADDR(), .VBUS_DATA(16'd0), .VBUS_SEL(), .VBUS_DTACK_N(1'b1),
+
+    .PAL(pal),
+    .CE_PIX(ce_pix), .FIELD_OUT(), .INTERLACE(), .RESOLUTION(resolution),
+    .HBL(hblank), .VBL(vblank),
+    .R(red), .G(green), .B(blue), .HS(), .VS(),
+
+    .SVP_QUIRK(1'b0),
+    .VRAM_SPEED(1'b0),              // full speed, so loading through the FIFO is quick
+    .VSCROLL_BUG(1'b0),
+    .BORDER_EN(1'b0),
+    .CRAM_DOTS(1'b0),
+    .OBJ_LIMIT_HIGH_EN(1'b0),
+    .TRANSP_DETECT(),
+
+    .BGA_EN(1'b1), .BGB_EN(1'b1), .SPR_EN(1'b1),
+    .dbg_in(8'd0), .dbg_out()
+);
+
+endmodule
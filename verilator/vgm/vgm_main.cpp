@@ -0,0 +1,296 @@
+// VGM player for the YM2612/SN76489 cores (vgm_top.sv).
+//
+// Plays the register writes of a .vgm file at their timestamps, writes a
+// 44.1Khz stereo WAV and reports throughput plus a hash of the output samples
+// for regression.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#include "Vvgm_top.h"
+#include "verilated.h"
+
+using namespace std;
+
+const uint64_t MCLK = 53693175;
+const int RATE = 44100;				// VGM sample rate, also used for the output
+
+Vvgm_top *top = new Vvgm_top;
+uint64_t cycles;
+bool quiet;
+
+// output, sampled at RATE from the MCLK domain
+FILE *wav;
+long long samples;
+uint64_t rate_acc;
+uint64_t audio_hash = 0xcbf29ce484222325ULL;		// FNV-1a over output samples
+
+void usage()
+{
+	printf("Usage: vgm [options] <file.vgm>\n");
+	printf("  -o F     write audio to F (default out.wav)\n");
+	printf("  -n       do not write audio\n");
+	printf("  -s S     stop after S seconds of audio\n");
+	printf("  -l N     LPF mode: 0 Model 1, 1 Model 2, 2 Minimal, 3 No Filter (default 3)\n");
+	printf("  -q       quiet, only print the final report\n");
+}
+
+struct Write {
+	uint64_t sample;				// VGM timestamp in 44.1Khz samples
+	uint8_t chip;					// 0: YM2612 port 0, 1: YM2612 port 1, 2: PSG
+	uint8_t reg, data;
+};
+
+static uint32_t rd32(const vector<uint8_t> &v, size_t off)
+{
+	if (off + 4 > v.size()) return 0;
+	return v[off] | v[off + 1] << 8 | v[off + 2] << 16 | (uint32_t)v[off + 3] << 24;
+}
+
+// parse VGM commands into a list of timestamped chip writes
+// returns total length in samples, or -1 on error
+long long parse_vgm(const vector<uint8_t> &vgm, vector<Write> &writes)
+{
+	if (vgm.size() < 0x40 || memcmp(vgm.data(), "Vgm ", 4) != 0) {
+		if (vgm.size() >= 2 && vgm[0] == 0x1f && vgm[1] == 0x8b)
+			printf("This is a compressed .vgz file, please gunzip it first\n");
+		else
+			printf("Not a VGM file\n");
+		return -1;
+	}
+	uint32_t version = rd32(vgm, 0x08);
+	size_t pos = 0x40;
+	if (version >= 0x150 && rd32(vgm, 0x34))
+		pos = 0x34 + rd32(vgm, 0x34);
+
+	vector<uint8_t> pcm;				// data block type 0 (YM2612 PCM)
+	size_t pcm_pos = 0;
+	uint64_t t = 0;
+	while (pos < vgm.size()) {
+		uint8_t cmd = vgm[pos];
+		if (cmd == 0x66)
+			break;
+		if (pos + 1 >= vgm.size()) break;
+		switch (cmd) {
+		case 0x50: writes.push_back({t, 2, 0, vgm[pos + 1]}); pos += 2; continue;
+		case 0x52:
+		case 0x53:
+			if (pos + 2 >= vgm.size()) return t;
+			writes.push_back({t, (uint8_t)(cmd - 0x52), vgm[pos + 1], vgm[pos + 2]});
+			pos += 3;
+			continue;
+		case 0x61:
+			if (pos + 2 >= vgm.size()) return t;
+			t += vgm[pos + 1] | vgm[pos + 2] << 8;
+			pos += 3;
+			continue;
+		case 0x62: t += 735; pos++; continue;
+		case 0x63: t += 882; pos++; continue;
+		case 0x67: {	// 0x67 0x66 tt ss ss ss ss
+			if (pos + 2 >= vgm.size()) return t;
+			uint8_t type = vgm[pos + 2];
+			uint32_t size = rd32(vgm, pos + 3) & 0x7fffffff;
+			if (type == 0 && pos + 7 + size <= vgm.size())
+				pcm.insert(pcm.end(), vgm.begin() + pos + 7, vgm.begin() + pos + 7 + size);
+			pos += 7 + size;
+			continue;
+		}
+		case 0xe0: pcm_pos = rd32(vgm, pos + 1); pos += 5; continue;
+		}
+		if ((cmd & 0xf0) == 0x70) {
+			t += (cmd & 0xf) + 1;
+			pos++;
+		} else if ((cmd & 0xf0) == 0x80) {		// YM2612 DAC from data bank, then wait
+			writes.push_back({t, 0, 0x2a, pcm_pos < pcm.size() ? pcm[pcm_pos] : (uint8_t)0x80});
+			pcm_pos++;
+			t += cmd & 0xf;
+			pos++;
+		}
+		// other chips and DAC stream control: skip by command length
+		else if ((cmd >= 0x30 && cmd <= 0x3f) || cmd == 0x4f) pos += 2;	// 0x4f: Game Gear PSG stereo
+		else if ((cmd >= 0x40 && cmd <= 0x4e) || cmd == 0x51 || (cmd >= 0x54 && cmd <= 0x5f) ||
+				 (cmd >= 0xa0 && cmd <= 0xbf)) pos += 3;
+		else if (cmd >= 0xc0 && cmd <= 0xdf) pos += 4;
+		else if (cmd >= 0xe1) pos += 5;
+		else if (cmd == 0x90 || cmd == 0x91 || cmd == 0x95) pos += 5;
+		else if (cmd == 0x92) pos += 6;
+		else if (cmd == 0x93) pos += 11;
+		else if (cmd == 0x94) pos += 2;
+		else {
+			printf("Unknown VGM command %02x at %zx\n", cmd, pos);
+			return -1;
+		}
+	}
+	return t;
+}
+
+static void put16(FILE *f, uint16_t v) { fputc(v & 0xff, f); fputc(v >> 8, f); }
+static void put32(FILE *f, uint32_t v) { put16(f, v & 0xffff); put16(f, v >> 16); }
+
+static void write_wav_header(FILE *f, uint32_t data_bytes)
+{
+	fwrite("RIFF", 1, 4, f); put32(f, 36 + data_bytes);
+	fwrite("WAVEfmt ", 1, 8, f); put32(f, 16);
+	put16(f, 1); put16(f, 2);
+	put32(f, RATE); put32(f, RATE * 4);
+	put16(f, 4); put16(f, 16);
+	fwrite("data", 1, 4, f); put32(f, data_bytes);
+}
+
+// one MCLK cycle
+static void tick()
+{
+	top->clk = 1;
+	top->eval();
+	top->clk = 0;
+	top->eval();
+	cycles++;
+
+	rate_acc += RATE;
+	if (rate_acc >= MCLK) {
+		rate_acc -= MCLK;
+		int16_t al = top->snd_left, ar = top->snd_right;
+		for (int16_t s : {al, ar}) {
+			audio_hash = (audio_hash ^ (uint8_t)s) * 0x100000001b3ULL;
+			audio_hash = (audio_hash ^ (uint8_t)(s >> 8)) * 0x100000001b3ULL;
+		}
+		if (wav) {
+			put16(wav, al);
+			put16(wav, ar);
+		}
+		samples++;
+		if (!quiet && samples % (RATE * 10) == 0)
+			printf("%lld seconds\n", samples / RATE);
+	}
+}
+
+// one clk wide write strobe
+static void fm_write(int addr, uint8_t data)
+{
+	top->fm_addr = addr;
+	top->fm_din = data;
+	top->fm_wr = 1;
+	tick();
+	top->fm_wr = 0;
+}
+
+int main(int argc, char **argv, char **env)
+{
+	Verilated::commandArgs(argc, argv);
+	const char *vgm_file = NULL, *out_file = "out.wav";
+	double max_seconds = 0;
+	int lpf = 3;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			out_file = argv[++i];
+		else if (strcmp(argv[i], "-n") == 0)
+			out_file = NULL;
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+			max_seconds = atof(argv[++i]);
+		else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+			lpf = atoi(argv[++i]) & 3;
+		else if (strcmp(argv[i], "-q") == 0)
+			quiet = true;
+		else if (argv[i][0] == '-') {
+			printf("Unrecognized option: %s\n", argv[i]);
+			usage();
+			exit(1);
+		} else
+			vgm_file = argv[i];
+	}
+	if (!vgm_file) {
+		usage();
+		exit(1);
+	}
+
+	FILE *f = fopen(vgm_file, "rb");
+	if (!f) {
+		printf("Cannot open file %s\n", vgm_file);
+		exit(1);
+	}
+	vector<uint8_t> vgm;
+	uint8_t buf[65536];
+	size_t r;
+	while ((r = fread(buf, 1, sizeof(buf), f)) > 0)
+		vgm.insert(vgm.end(), buf, buf + r);
+	fclose(f);
+
+	vector<Write> writes;
+	long long total = parse_vgm(vgm, writes);
+	if (total < 0)
+		exit(1);
+	if (max_seconds > 0 && total > max_seconds * RATE)
+		total = max_seconds * RATE;
+	printf("%s: %zu writes, %.1f seconds\n", vgm_file, writes.size(), (double)total / RATE);
+
+	// reset, jt12 needs at least 6 cen cycles
+	top->lpf_mode = lpf;
+	top->reset = 1;
+	for (int i = 0; i < 256; i++) tick();
+	top->reset = 0;
+	cycles = 0;
+	samples = 0;
+	rate_acc = 0;
+	audio_hash = 0xcbf29ce484222325ULL;
+
+	if (out_file) {
+		wav = fopen(out_file, "wb");
+		if (!wav) {
+			printf("Cannot open %s for writing\n", out_file);
+			exit(1);
+		}
+		write_wav_header(wav, 0);
+	}
+
+	auto start = chrono::steady_clock::now();
+	size_t wi = 0;
+	uint8_t fm_reg[2] = {0xff, 0xff};		// last register selected on each port
+	int fm_port = -1;
+
+	while (samples < total) {
+		// issue due writes. Like a real sound driver, wait for the YM2612
+		// busy flag before each data write, except for the DAC register.
+		if (wi < writes.size() && writes[wi].sample <= (uint64_t)samples) {
+			Write &w = writes[wi];
+			if (w.chip == 2) {
+				top->psg_din = w.data;
+				top->psg_wr = 1;
+				tick();
+				top->psg_wr = 0;
+				wi++;
+				continue;
+			} else if (!(top->fm_dout & 0x80) || w.reg == 0x2a) {
+				if (fm_port != w.chip || fm_reg[w.chip] != w.reg) {
+					fm_write(w.chip * 2, w.reg);
+					fm_port = w.chip;
+					fm_reg[w.chip] = w.reg;
+				}
+				fm_write(w.chip * 2 + 1, w.data);
+				wi++;
+				continue;
+			}
+		}
+
+		tick();
+	}
+
+	double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	if (wav) {
+		fseek(wav, 0, SEEK_SET);
+		write_wav_header(wav, samples * 4);
+		fclose(wav);
+		printf("Audio written to %s\n", out_file);
+	}
+	printf("Samples: %lld, cycles: %llu, time: %.2fs\n", samples, (unsigned long long)cycles, secs);
+	printf("Throughput: %.0f samples/s (%.2fx realtime), %.2f Mcycles/s\n",
+		   samples / secs, samples / secs / RATE, cycles / secs / 1e6);
+	printf("Audio hash: %016llx\n", (unsigned long long)audio_hash);
+
+	top->final();
+	delete top;
+	return 0;
+}
@@ -0,0 +1,87 @@
+// Sound-only harness: YM2612 (jt12) + SN76489 (jt89) with the same clock
+// enables, scaling, mixing and filters as system.sv. Driven by vgm_main.cpp.
+module vgm_top (
+    input clk,                      // 53.69Mhz MCLK
+    input reset,
+
+    input [1:0] lpf_mode,           // Model 1,Model 2,Minimal,No Filter
+
+    // YM2612 bus, one clk wide write strobes
+    input [1:0] fm_addr,
+    input [7:0] fm_din,
+    input fm_wr,
+    output [7:0] fm_dout,
+
+    // SN76489
+    input [7:0] psg_din,
+    input psg_wr,
+
+    output signed [15:0] snd_left,
+    output signed [15:0] snd_right
+);
+
+// clock enables as in system.sv: FM = MCLK/7, PSG = MCLK/15
+reg FM_CLKEN, PSG_CLKEN;
+reg [3:0] FCLKCNT, PCLKCNT;
+always @(posedge clk) begin
+    if (reset) begin
+        FCLKCNT <= 0;
+        PCLKCNT <= 0;
+        FM_CLKEN <= 1;
+        PSG_CLKEN <= 1;
+    end else begin
+        FM_CLKEN <= 0;
+        FCLKCNT <= FCLKCNT + 1'b1;
+        if (FCLKCNT == 6) begin
+            FCLKCNT <= 0;
+            FM_CLKEN <= 1;
+        end
+
+        PSG_CLKEN <= 0;
+        PCLKCNT <= PCLKCNT + 1'b1;
+        if (PCLKCNT == 14) begin
+            PCLKCNT <= 0;
+            PSG_CLKEN <= 1;
+        end
+    end
+end
+
+wire signed [10:0] PSG_SND;
+jt89 psg (
+    .rst(reset), .clk(clk), .clk_en(PSG_CLKEN),
+    .wr_n(~psg_wr), .din(psg_din),
+    .sound(PSG_SND), .ready()
+);
+
+wire signed [15:0] FM_left, FM_right;
+jt12 fm (
+    .rst(reset), .clk(clk), .cen(FM_CLKEN),
+    .cs_n(1'b0), .addr(fm_addr), .wr_n(~fm_wr), .din(fm_din), .dout(fm_dout), .irq_n(),
+    .en_hifi_pcm(1'b0), .ladder(1'b0),
+    .snd_left(FM_left), .snd_right(FM_right), .snd_sample()
+);
+
+wire signed [15:0] fm_adjust_l = (FM_left  << 4) + (FM_left  << 2) + (FM_left  << 1) + (FM_left  >>> 2);
+wire signed [15:0] fm_adjust_r = (FM_right << 4) + (FM_right << 2) + (FM_right << 1) + (FM_right >>> 2);
+
+wire signed [15:0] FM_LPF_left, FM_LPF_right;
+genesis_fm_lpf fm_lpf_l (.clk(clk), .reset(reset), .in(fm_adjust_l), .out(FM_LPF_left));
+genesis_fm_lpf fm_lpf_r (.clk(clk), .reset(reset), .in(fm_adjust_r), .out(FM_LPF_right));
+
+wire signed [15:0] fm_select_l = (lpf_mode == 2'b01) ? FM_LPF_left : fm_adjust_l;
+wire signed [15:0] fm_select_r = (lpf_mode == 2'b01) ? FM_LPF_right : fm_adjust_r;
+
+wire signed [10:0] psg_adjust = PSG_SND - (PSG_SND >>> 5);
+
+wire signed [15:0] PRE_LPF_L, PRE_LPF_R;
+jt12_genmix genmix (
+    .rst(reset), .clk(clk),
+    .fm_left(fm_select_l), .fm_right(fm_select_r), .psg_snd(psg_adjust),
+    .fm_en(1'b1), .psg_en(1'b1),
+    .snd_left(PRE_LPF_L), .snd_right(PRE_LPF_R)
+);
+
+genesis_lpf lpf_left (.clk(clk), .reset(reset), .lpf_mode(lpf_mode), .in(PRE_LPF_L), .out(snd_left));
+genesis_lpf lpf_right (.clk(clk), .reset(reset), .lpf_mode(lpf_mode), .in(PRE_LPF_R), .out(snd_right));
+
+endmodule